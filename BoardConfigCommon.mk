@@ -25,6 +25,7 @@ HAVE_HTC_AUDIO_DRIVER := true
 BOARD_USES_GENERIC_AUDIO := true
 #gps 
 #"simulator":taget board does not have a gps hardware module;"haiweixun":use the gps module offer by haiweixun 
+#"uart":nmea receiver on the serial port named by GPS_DEVICE/GPS_BAUD in gps.conf
 BOARD_USES_GPS_TYPE := simulator
 
 # Set /system/bin/sh to ash, not mksh, to make sure we can switch back.
@@ -20,6 +20,7 @@
 #include <cutils/log.h>
 
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
@@ -32,29 +33,121 @@
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <cutils/properties.h>
 
 #include <hardware/display.h>
 #include <drv_display_sun4i.h>
 #include <g2d_driver.h>
 #include <fb.h>
+#include <pthread.h>
+
+#include "display_priv.h"
 
 #define MAX_DISPLAY_NUM		2
 #define DEBUG_MDP_ERRORS 	1
 
+/* pixel format of the scaled copy that mirrors the master screen in dual same mode,
+ * g2d converts on the fly so 16bpp halves the memory and scanout bandwidth of it */
+#define SECONDARY_PIXEL_FORMAT  HAL_PIXEL_FORMAT_RGB_565
+
+/* largest downscale the secondary screen's layer scaler takes when it scans out the master fb directly */
+#define DISPLAY_CLONE_MAX_DOWNSCALE 4
+
+/* pending asynchronous mode requests per device, and callers one merged request completes */
+#define DISPLAY_ASYNC_QUEUE_LEN     8
+#define DISPLAY_ASYNC_MAX_WAITERS   8
+
+/* last committed configuration, restored by the first open of a boot */
+#define DISPLAY_CONFIG_FILE         "/data/system/display.cfg"
+#define DISPLAY_CONFIG_MAGIC        0x44495350
+#define DISPLAY_CONFIG_VERSION      1
+#define DISPLAY_RESTORED_PROPERTY   "sys.display.restored"
+#define DISPLAY_RESTORED_CLAIMED    "1"     /* a process restores, or kept the boot mode */
+#define DISPLAY_RESTORED_APPLIED    "2"     /* the hardware runs the saved configuration */
+/* the fbs and clone layer the process that drove the hardware set up for it */
+#define DISPLAY_FBSTATE_PROPERTY    "sys.display.fbstate"
+
+/* largest overscan compensation per edge, in percent of the output size */
+#define DISPLAY_OVERSCAN_MAX        20
+
 #define LOG_NDEBUG          0
 
+/* secondary screen layer scanning out the master framebuffer in dual same mode */
+struct display_clone_t
+{
+    unsigned long               hdl;
+    int                         screen;
+    int                         srcfb;
+    int                         xres;
+    int                         yres;
+};
+
+/* picture area set by the user on a screen, in percent of the output size cut from each edge */
+struct display_overscan_t
+{
+    bool                        enabled;
+    int                         left;
+    int                         top;
+    int                         right;
+    int                         bottom;
+};
+
 int                         g_displaymode = 0;
 int                         g_masterdisplay = 0;
 struct display_output_t     g_display[MAX_DISPLAY_NUM];
+struct display_clone_t      g_clone;
+struct display_overscan_t   g_overscan[MAX_DISPLAY_NUM];
 pthread_mutex_t             mode_lock;
+pthread_mutex_t             save_lock = PTHREAD_MUTEX_INITIALIZER;
+unsigned int                g_saveseq = 0;
 bool                        mutex_inited = false;
+enum
+{
+    DISPLAY_ASYNC_SETMODE = 0,
+    DISPLAY_ASYNC_CHANGEMODE,
+    DISPLAY_ASYNC_SETMASTER
+};
+
+struct display_async_waiter_t
+{
+    display_async_callback_t    callback;
+    void                       *user;
+    int                         token;
+};
+
+struct display_async_req_t
+{
+    int                         kind;
+    int                         value[3];
+    struct display_modepara_t   para;
+    int                         nwaiters;
+    struct display_async_waiter_t waiters[DISPLAY_ASYNC_MAX_WAITERS];
+};
+
+/* worker running the asynchronous requests of one device, started on the first of them */
+struct display_async_t
+{
+    pthread_t                   thread;
+    pthread_mutex_t             lock;
+    pthread_cond_t              cond;
+    bool                        started;
+    bool                        quit;
+    bool                        closing;    /* closed from a callback, the worker frees the device on its way out */
+    int                         head;
+    int                         count;
+    int                         next_token;
+    struct display_async_req_t  queue[DISPLAY_ASYNC_QUEUE_LEN];
+};
+
 /** State information for each device instance */
 struct display_context_t 
 {
-    struct display_device_t     device;
+    struct private_display_device_t device;
     int                         mFD_fb[MAX_DISPLAY_NUM];
     int		                    mFD_disp;
     int                         mFD_mp;
+    struct display_async_t      async;
 };
 
 struct display_fbpara_t
@@ -71,6 +164,29 @@ struct display_fbpara_t
     int							format;
 };
 
+/* secondary screen of dual same mode, kept to put it back after a hot unplug */
+struct display_secondary_t
+{
+    struct display_fbpara_t     para;
+    bool                        released;
+};
+
+struct display_secondary_t  g_secondary;
+
+/* layout of DISPLAY_CONFIG_FILE */
+struct display_savedconfig_t
+{
+    uint32_t                    magic;
+    uint32_t                    version;
+    uint32_t                    size;
+    struct display_config_t     config;
+    uint32_t                    checksum;
+};
+
+static unsigned int display_snapconfig(struct display_savedconfig_t *saved);
+static int  display_saveconfig(const struct display_savedconfig_t *saved,unsigned int seq);
+static void display_publishfbstate(void);
+
 /**
  * Common hardware methods
  */
@@ -100,28 +216,144 @@ struct display_module_t HAL_MODULE_INFO_SYM =
     }
 };
 
+/*
+ * Every output format the HAL knows: DISPLAY_* id, driver mode, active and safe area size, refresh, scan and the
+ * outputs able to drive it. driver is -1 for the combined cvbs+svideo formats the driver has no mode for.
+ */
+#define DISPLAY_MODE_INDEX_SIZE     256
+
+struct display_modedesc_t
+{
+    struct display_modeinfo_t   info;
+    int                         driver;
+    int                         tvdac;
+};
+
+#define TV_YPBPR    (DISPLAY_MODE_OUTPUT_TV | DISPLAY_MODE_OUTPUT_HDMI)
+
+static const struct display_modedesc_t g_modes[] =
+{
+    /*  id                                    width height vwidth vheight hz  i  outputs                        driver                      tvdac */
+    {{  DISPLAY_TVFORMAT_480I,                720,  480,   660,   440,    60, 1, TV_YPBPR                 },  DISP_TV_MOD_480I,           DISPLAY_TVDAC_YPBPR  },
+    {{  DISPLAY_TVFORMAT_576I,                720,  576,   660,   536,    50, 1, TV_YPBPR                 },  DISP_TV_MOD_576I,           DISPLAY_TVDAC_YPBPR  },
+    {{  DISPLAY_TVFORMAT_480P,                720,  480,   660,   440,    60, 0, TV_YPBPR                 },  DISP_TV_MOD_480P,           DISPLAY_TVDAC_YPBPR  },
+    {{  DISPLAY_TVFORMAT_576P,                720,  576,   660,   536,    50, 0, TV_YPBPR                 },  DISP_TV_MOD_576P,           DISPLAY_TVDAC_YPBPR  },
+    {{  DISPLAY_TVFORMAT_720P_50HZ,           1280, 720,   1220,  680,    50, 0, TV_YPBPR                 },  DISP_TV_MOD_720P_50HZ,      DISPLAY_TVDAC_YPBPR  },
+    {{  DISPLAY_TVFORMAT_720P_60HZ,           1280, 720,   1220,  680,    60, 0, TV_YPBPR                 },  DISP_TV_MOD_720P_60HZ,      DISPLAY_TVDAC_YPBPR  },
+    {{  DISPLAY_TVFORMAT_1080I_50HZ,          1920, 1080,  1840,  1040,   50, 1, TV_YPBPR                 },  DISP_TV_MOD_1080I_50HZ,     DISPLAY_TVDAC_YPBPR  },
+    {{  DISPLAY_TVFORMAT_1080I_60HZ,          1920, 1080,  1840,  1040,   60, 1, TV_YPBPR                 },  DISP_TV_MOD_1080I_60HZ,     DISPLAY_TVDAC_YPBPR  },
+    {{  DISPLAY_TVFORMAT_1080P_24HZ,          1920, 1080,  1840,  1040,   24, 0, TV_YPBPR                 },  DISP_TV_MOD_1080P_24HZ,     DISPLAY_TVDAC_YPBPR  },
+    {{  DISPLAY_TVFORMAT_1080P_50HZ,          1920, 1080,  1840,  1040,   50, 0, TV_YPBPR                 },  DISP_TV_MOD_1080P_50HZ,     DISPLAY_TVDAC_YPBPR  },
+    {{  DISPLAY_TVFORMAT_1080P_60HZ,          1920, 1080,  1840,  1040,   60, 0, TV_YPBPR                 },  DISP_TV_MOD_1080P_60HZ,     DISPLAY_TVDAC_YPBPR  },
+    {{  DISPLAY_TVFORMAT_NTSC,                720,  480,   660,   440,    60, 1, DISPLAY_MODE_OUTPUT_TV   },  DISP_TV_MOD_NTSC,           DISPLAY_TVDAC_CVBS   },
+    {{  DISPLAY_TVFORMAT_NTSC_SVIDEO,         720,  480,   660,   440,    60, 1, DISPLAY_MODE_OUTPUT_TV   },  DISP_TV_MOD_NTSC_SVIDEO,    DISPLAY_TVDAC_SVIDEO },
+    {{  DISPLAY_TVFORMAT_NTSC_CVBS_SVIDEO,    720,  480,   660,   440,    60, 1, DISPLAY_MODE_OUTPUT_TV   },  -1,                         DISPLAY_TVDAC_NONE   },
+    {{  DISPLAY_TVFORMAT_PAL,                 720,  576,   660,   536,    50, 1, DISPLAY_MODE_OUTPUT_TV   },  DISP_TV_MOD_PAL,            DISPLAY_TVDAC_CVBS   },
+    {{  DISPLAY_TVFORMAT_PAL_SVIDEO,          720,  576,   660,   536,    50, 1, DISPLAY_MODE_OUTPUT_TV   },  DISP_TV_MOD_PAL_SVIDEO,     DISPLAY_TVDAC_SVIDEO },
+    {{  DISPLAY_TVFORMAT_PAL_CVBS_SVIDEO,     720,  576,   660,   536,    50, 1, DISPLAY_MODE_OUTPUT_TV   },  -1,                         DISPLAY_TVDAC_NONE   },
+    {{  DISPLAY_TVFORMAT_PAL_M,               720,  576,   660,   536,    60, 1, DISPLAY_MODE_OUTPUT_TV   },  DISP_TV_MOD_PAL_M,          DISPLAY_TVDAC_CVBS   },
+    {{  DISPLAY_TVFORMAT_PAL_M_SVIDEO,        720,  576,   660,   536,    60, 1, DISPLAY_MODE_OUTPUT_TV   },  DISP_TV_MOD_PAL_M_SVIDEO,   DISPLAY_TVDAC_SVIDEO },
+    {{  DISPLAY_TVFORMAT_PAL_M_CVBS_SVIDEO,   720,  576,   660,   536,    60, 1, DISPLAY_MODE_OUTPUT_TV   },  -1,                         DISPLAY_TVDAC_NONE   },
+    {{  DISPLAY_TVFORMAT_PAL_NC,              720,  576,   660,   536,    50, 1, DISPLAY_MODE_OUTPUT_TV   },  DISP_TV_MOD_PAL_NC,         DISPLAY_TVDAC_CVBS   },
+    {{  DISPLAY_TVFORMAT_PAL_NC_SVIDEO,       720,  576,   660,   536,    50, 1, DISPLAY_MODE_OUTPUT_TV   },  DISP_TV_MOD_PAL_NC_SVIDEO,  DISPLAY_TVDAC_SVIDEO },
+    {{  DISPLAY_TVFORMAT_PAL_NC_CVBS_SVIDEO,  720,  576,   660,   536,    50, 1, DISPLAY_MODE_OUTPUT_TV   },  -1,                         DISPLAY_TVDAC_NONE   },
+    {{  DISPLAY_VGA_H1680_V1050,              1680, 1050,  1680,  1050,   60, 0, DISPLAY_MODE_OUTPUT_VGA  },  DISP_VGA_H1680_V1050,       DISPLAY_TVDAC_NONE   },
+    {{  DISPLAY_VGA_H1440_V900,               1440, 900,   1440,  900,    60, 0, DISPLAY_MODE_OUTPUT_VGA  },  DISP_VGA_H1440_V900,        DISPLAY_TVDAC_NONE   },
+    {{  DISPLAY_VGA_H1360_V768,               1360, 768,   1360,  768,    60, 0, DISPLAY_MODE_OUTPUT_VGA  },  DISP_VGA_H1360_V768,        DISPLAY_TVDAC_NONE   },
+    {{  DISPLAY_VGA_H1280_V1024,              1280, 1024,  1280,  1024,   60, 0, DISPLAY_MODE_OUTPUT_VGA  },  DISP_VGA_H1280_V1024,       DISPLAY_TVDAC_NONE   },
+    {{  DISPLAY_VGA_H1024_V768,               1024, 768,   1024,  768,    60, 0, DISPLAY_MODE_OUTPUT_VGA  },  DISP_VGA_H1024_V768,        DISPLAY_TVDAC_NONE   },
+    {{  DISPLAY_VGA_H800_V600,                800,  600,   800,   600,    60, 0, DISPLAY_MODE_OUTPUT_VGA  },  DISP_VGA_H800_V600,         DISPLAY_TVDAC_NONE   },
+    {{  DISPLAY_VGA_H640_V480,                640,  480,   640,   480,    60, 0, DISPLAY_MODE_OUTPUT_VGA  },  DISP_VGA_H640_V480,         DISPLAY_TVDAC_NONE   },
+    {{  DISPLAY_VGA_H1440_V900_RB,            1440, 900,   1440,  900,    60, 0, DISPLAY_MODE_OUTPUT_VGA  },  DISP_VGA_H1440_V900_RB,     DISPLAY_TVDAC_NONE   },
+    {{  DISPLAY_VGA_H1680_V1050_RB,           1680, 1050,  1680,  1050,   60, 0, DISPLAY_MODE_OUTPUT_VGA  },  DISP_VGA_H1680_V1050_RB,    DISPLAY_TVDAC_NONE   },
+    {{  DISPLAY_VGA_H1920_V1080_RB,           1920, 1080,  1920,  1080,   60, 0, DISPLAY_MODE_OUTPUT_VGA  },  DISP_VGA_H1920_V1080_RB,    DISPLAY_TVDAC_NONE   },
+    {{  DISPLAY_VGA_H1920_V1080,              1920, 1080,  1920,  1080,   60, 0, DISPLAY_MODE_OUTPUT_VGA  },  DISP_VGA_H1920_V1080,       DISPLAY_TVDAC_NONE   },
+    {{  DISPLAY_VGA_H1280_V720,               1280, 720,   1280,  720,    60, 0, DISPLAY_MODE_OUTPUT_VGA  },  DISP_VGA_H1280_V720,        DISPLAY_TVDAC_NONE   },
+};
+
+#undef TV_YPBPR
+
+#define DISPLAY_MODE_NUM            ((int)(sizeof(g_modes) / sizeof(g_modes[0])))
+
+/* id -> entry and tv/hdmi driver mode -> entry, -1 where there is none */
+static signed char                  g_modeindex[DISPLAY_MODE_INDEX_SIZE];
+static signed char                  g_tvmodeindex[DISPLAY_MODE_INDEX_SIZE];
+static pthread_once_t               g_modeonce = PTHREAD_ONCE_INIT;
+
+static void display_initmodeindex(void)
+{
+    int     i;
+
+    memset(g_modeindex,-1,sizeof(g_modeindex));
+    memset(g_tvmodeindex,-1,sizeof(g_tvmodeindex));
+    for(i = 0;i < DISPLAY_MODE_NUM;i++)
+    {
+        if((unsigned)g_modes[i].info.id < DISPLAY_MODE_INDEX_SIZE)
+        {
+            g_modeindex[g_modes[i].info.id] = i;
+        }
+
+        /* vga driver modes count from 0 again, only tv/hdmi ones are read back */
+        if(!(g_modes[i].info.outputs & DISPLAY_MODE_OUTPUT_VGA) && ((unsigned)g_modes[i].driver < DISPLAY_MODE_INDEX_SIZE))
+        {
+            g_tvmodeindex[g_modes[i].driver] = i;
+        }
+    }
+}
+
+static const struct display_modedesc_t *display_findmode(int format)
+{
+    pthread_once(&g_modeonce,display_initmodeindex);
+
+    if(((unsigned)format >= DISPLAY_MODE_INDEX_SIZE) || (g_modeindex[format] < 0))
+    {
+        return  NULL;
+    }
+
+    return  &g_modes[(int)g_modeindex[format]];
+}
+
+static const struct display_modedesc_t *display_findtvdrivermode(int driver)
+{
+    pthread_once(&g_modeonce,display_initmodeindex);
+
+    if(((unsigned)driver >= DISPLAY_MODE_INDEX_SIZE) || (g_tvmodeindex[driver] < 0))
+    {
+        return  NULL;
+    }
+
+    return  &g_modes[(int)g_tvmodeindex[driver]];
+}
+
       
 /*
 **********************************************************************************************************************
-*                                               display_gethdmistatus
+*                                               display_readhdmistatus
 *
 * author:           
 *
-* date:             2011-7-17:11:22:0
+* date:             2026-10-17:19:00:0
 *
-* Description:      get hdmi hot plug status 
+* Description:      read the hdmi hot plug status, the modes asked of the sink before are forgotten when it changed.
+*                   the cache below lives as long as the plug, guarded by hdmi_lock: the mode queries do not take
+*                   the mode lock
 *
 * parameters:       
 *
-* return:           if success return GUI_RET_OK
-*                   if fail return the number of fail
+* return:           hot plug status, 0 if unplugged
 * modify history: 
 **********************************************************************************************************************
 */
-static int display_gethdmistatus(struct display_device_t *dev)
+/* modes of g_modes[] the hdmi sink was asked about and those it takes */
+static pthread_mutex_t              hdmi_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t                     g_hdmichecked;
+static uint64_t                     g_hdmisupported;
+static int                          g_hdmihpd = -1;
+
+static int display_readhdmistatus(struct display_context_t* ctx)
 {
-    struct display_context_t* ctx = (struct display_context_t*)dev;
-    
+    int     status;
+
     if(ctx)
     {
         if(ctx->mFD_disp)
@@ -130,79 +362,123 @@ static int display_gethdmistatus(struct display_device_t *dev)
         	
         	args[0] = 0;
         	
-            return ioctl(ctx->mFD_disp,DISP_CMD_HDMI_GET_HPD_STATUS,args);
+            status = ioctl(ctx->mFD_disp,DISP_CMD_HDMI_GET_HPD_STATUS,args);
+
+            pthread_mutex_lock(&hdmi_lock);
+            if(status != g_hdmihpd)
+            {
+                /* another sink, or none */
+                g_hdmichecked   = 0;
+                g_hdmisupported = 0;
+                g_hdmihpd       = status;
+            }
+            pthread_mutex_unlock(&hdmi_lock);
+
+            return status;
         }
     }
 
     return 0;    
 }
 
+/*
+**********************************************************************************************************************
+*                                               display_hdmisupportmode
+*
+* author:           
+*
+* date:             2026-10-17:19:00:0
+*
+* Description:      whether the hdmi sink takes a format, the edid is asked once per mode and plug. the caller
+*                   reads the hot plug state with display_readhdmistatus once per query, before asking for any
+*                   number of formats
+*
+* parameters:       format: DISPLAY_TVFORMAT_*
+*
+* return:           true if supported
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static bool display_hdmisupportmode(struct display_context_t* ctx,int format)
+{
+    const struct display_modedesc_t *desc = display_findmode(format);
+    unsigned long                   args[4];
+    uint64_t                        bit;
+    bool                            supported;
+
+    if((desc == NULL) || !(desc->info.outputs & DISPLAY_MODE_OUTPUT_HDMI) || (ctx == NULL) || (ctx->mFD_disp == 0))
+    {
+        return  false;
+    }
+
+    bit = 1ULL << (desc - g_modes);
+
+    pthread_mutex_lock(&hdmi_lock);
+    if(!(g_hdmichecked & bit))
+    {
+        args[0] = 0;
+        args[1] = desc->driver;
+        if(ioctl(ctx->mFD_disp,DISP_CMD_HDMI_SUPPORT_MODE,args))
+        {
+            g_hdmisupported |= bit;
+        }
+        g_hdmichecked |= bit;
+    }
+    supported = (g_hdmisupported & bit) != 0;
+    pthread_mutex_unlock(&hdmi_lock);
+
+    return  supported;
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_gethdmistatus
+*
+* author:           
+*
+* date:             2011-7-17:11:22:0
+*
+* Description:      get hdmi hot plug status 
+*
+* parameters:       
+*
+* return:           if success return GUI_RET_OK
+*                   if fail return the number of fail
+* modify history: 
+**********************************************************************************************************************
+*/
+static int display_gethdmistatus(struct display_device_t *dev)
+{
+    struct display_context_t* ctx = (struct display_context_t*)dev;
+    int                       status;
+
+    status = display_readhdmistatus(ctx);
+
+    return status;
+}
+
 static int display_gethdmimaxmode(struct display_device_t *dev)
 {
     struct display_context_t* ctx = (struct display_context_t*)dev;
+    /* best first */
+    static const int          preferred[] = 
+    {
+        DISPLAY_TVFORMAT_1080P_60HZ,
+        DISPLAY_TVFORMAT_1080P_50HZ,
+        DISPLAY_TVFORMAT_720P_60HZ,
+        DISPLAY_TVFORMAT_720P_50HZ,
+        DISPLAY_TVFORMAT_1080I_60HZ,
+        DISPLAY_TVFORMAT_1080I_50HZ
+    };
+    unsigned int              i;
     
-    if(ctx)
+    display_readhdmistatus(ctx);
+    for(i = 0;i < sizeof(preferred) / sizeof(preferred[0]);i++)
     {
-        if(ctx->mFD_disp)
+        if(display_hdmisupportmode(ctx,preferred[i]))
         {
-        	unsigned long args[4];
-        	
-        	args[0] = 0;
-        	args[1] = DISP_TV_MOD_1080P_60HZ;
-
-            if(ioctl(ctx->mFD_disp,DISP_CMD_HDMI_SUPPORT_MODE,args))
-            {
-                return DISPLAY_TVFORMAT_1080P_60HZ;
-            }
-            else 
-            {
-            	args[1] = DISP_TV_MOD_1080P_50HZ;
-
-	            if(ioctl(ctx->mFD_disp,DISP_CMD_HDMI_SUPPORT_MODE,args))
-	            {
-	                return DISPLAY_TVFORMAT_1080P_50HZ;
-	            }
-	            else 
-	            {
-	            	args[1] = DISPLAY_TVFORMAT_720P_60HZ;
-
-		            if(ioctl(ctx->mFD_disp,DISP_CMD_HDMI_SUPPORT_MODE,args))
-		            {
-		                return DISPLAY_TVFORMAT_720P_60HZ;
-		            }
-		            else
-		            {
-		            	args[1] = DISP_TV_MOD_720P_50HZ;
-
-			            if(ioctl(ctx->mFD_disp,DISP_CMD_HDMI_SUPPORT_MODE,args))
-			            {
-			                return DISPLAY_TVFORMAT_720P_50HZ;
-			            }
-			            else
-			            {
-			            	args[1] = DISP_TV_MOD_1080I_60HZ;
-
-				            if(ioctl(ctx->mFD_disp,DISP_CMD_HDMI_SUPPORT_MODE,args))
-				            {
-				                return DISPLAY_TVFORMAT_1080I_60HZ;
-				            }
-				            else
-				            {
-				            	args[1] = DISP_TV_MOD_1080I_50HZ;
-
-					            if(ioctl(ctx->mFD_disp,DISP_CMD_HDMI_SUPPORT_MODE,args))
-					            {
-					                return DISPLAY_TVFORMAT_1080I_50HZ;
-					            }
-					            else
-					            {
-					            	return DISPLAY_TVFORMAT_720P_50HZ;
-					            }
-				            }
-			            }
-		            }
-	            }
-            }
+            return  preferred[i];
         }
     }
 
@@ -226,9 +502,8 @@ static int display_gethdmimaxmode(struct display_device_t *dev)
 **********************************************************************************************************************
 */
 
-static int display_gettvdacstatus(struct display_device_t *dev)
+static int display_readtvdacstatus(struct display_context_t* ctx)
 {
-    struct display_context_t* ctx = (struct display_context_t*)dev;
     int                       status;
     
     if(ctx)
@@ -260,6 +535,16 @@ static int display_gettvdacstatus(struct display_device_t *dev)
 
     return DISPLAY_TVDAC_NONE;
 }
+
+static int display_gettvdacstatus(struct display_device_t *dev)
+{
+    struct display_context_t* ctx = (struct display_context_t*)dev;
+    int                       status;
+
+    status = display_readtvdacstatus(ctx);
+
+    return status;
+}
       
 /*
 **********************************************************************************************************************
@@ -335,6 +620,7 @@ static int display_getoutputtype(struct display_device_t *dev,int displayno)
 static int display_gettvformat(struct display_device_t *dev,int displayno)
 {
     struct display_context_t* ctx = (struct display_context_t*)dev;
+    const struct display_modedesc_t *desc;
     int                       ret;
 
     
@@ -346,82 +632,12 @@ static int display_gettvformat(struct display_device_t *dev,int displayno)
 
             args[0] = displayno;
             ret = ioctl(ctx->mFD_disp,DISP_CMD_TV_GET_MODE,args);
-            if(ret == DISP_TV_MOD_480I)
-            {
-                return  DISPLAY_TVFORMAT_480I;
-            }
-            else if(ret == DISP_TV_MOD_576I)
-            {
-                return  DISPLAY_TVFORMAT_576I;
-            }
-            else if(ret == DISP_TV_MOD_480P)
-            {
-                return  DISPLAY_TVFORMAT_480P;
-            }
-            else if(ret == DISP_TV_MOD_576P)
-            {
-                return  DISPLAY_TVFORMAT_576P;
-            } 
-            else if(ret == DISP_TV_MOD_720P_50HZ)
-            {
-                return  DISPLAY_TVFORMAT_720P_50HZ;
-            }
-            else if(ret == DISP_TV_MOD_720P_60HZ)
-            {
-                return  DISPLAY_TVFORMAT_720P_60HZ;
-            }
-            else if(ret == DISP_TV_MOD_1080I_50HZ)
-            {
-                return  DISPLAY_TVFORMAT_1080I_50HZ;
-            } 
-            else if(ret == DISP_TV_MOD_1080I_60HZ)
-            {
-                return  DISPLAY_TVFORMAT_1080I_60HZ;
-            }
-            else if(ret == DISP_TV_MOD_1080P_24HZ)
-            {
-                return  DISPLAY_TVFORMAT_1080P_24HZ;
-            }
-            else if(ret == DISP_TV_MOD_1080P_50HZ)
-            {
-                return  DISPLAY_TVFORMAT_1080P_50HZ;
-            } 
-            else if(ret == DISP_TV_MOD_1080P_60HZ)
-            {
-                return  DISPLAY_TVFORMAT_1080P_60HZ;
-            }
-            else if(ret == DISP_TV_MOD_PAL)
-            {
-                return  DISPLAY_TVFORMAT_PAL;
-            }
-            else if(ret == DISP_TV_MOD_PAL_SVIDEO)
-            {
-                return  DISPLAY_TVFORMAT_PAL_SVIDEO;
-            }            
-            else if(ret == DISP_TV_MOD_NTSC)
-            {
-                return  DISPLAY_TVFORMAT_NTSC;
-            }
-            else if(ret == DISP_TV_MOD_NTSC_SVIDEO)
-            {
-                return  DISPLAY_TVFORMAT_NTSC_SVIDEO;
-            }              
-            else if(ret == DISP_TV_MOD_PAL_M)
-            {
-                return  DISPLAY_TVFORMAT_PAL_M;
-            }
-            else if(ret == DISP_TV_MOD_PAL_M_SVIDEO)
-            {
-                return  DISPLAY_TVFORMAT_PAL_M_SVIDEO;
-            }            
-            else if(ret == DISP_TV_MOD_PAL_NC)
+
+            desc = display_findtvdrivermode(ret);
+            if(desc)
             {
-                return  DISPLAY_TVFORMAT_PAL_NC;
+                return  desc->info.id;
             }
-            else if(ret == DISP_TV_MOD_PAL_NC_SVIDEO)
-            {
-                return  DISPLAY_TVFORMAT_PAL_NC_SVIDEO;
-            }             
         }
     }
 
@@ -448,30 +664,9 @@ static int display_gettvformat(struct display_device_t *dev,int displayno)
 
 static int  display_gettvtype(int  tvformat)
 {
-    switch(tvformat)
-    {
-        case  DISPLAY_TVFORMAT_480I:
-        case  DISPLAY_TVFORMAT_576I:
-        case  DISPLAY_TVFORMAT_480P:
-        case  DISPLAY_TVFORMAT_576P:
-        case  DISPLAY_TVFORMAT_720P_50HZ:
-        case  DISPLAY_TVFORMAT_720P_60HZ:
-        case  DISPLAY_TVFORMAT_1080I_50HZ:
-        case  DISPLAY_TVFORMAT_1080I_60HZ:
-        case  DISPLAY_TVFORMAT_1080P_50HZ:
-        case  DISPLAY_TVFORMAT_1080P_60HZ:
-        case  DISPLAY_TVFORMAT_1080P_24HZ:
-            return  DISPLAY_TVDAC_YPBPR;
-
-        case  DISPLAY_TVFORMAT_PAL:
-        case  DISPLAY_TVFORMAT_NTSC:
-        case  DISPLAY_TVFORMAT_PAL_M:
-        case  DISPLAY_TVFORMAT_PAL_NC:
-            return  DISPLAY_TVDAC_CVBS;
+    const struct display_modedesc_t *desc = display_findmode(tvformat);
 
-        default:
-            return  DISPLAY_TVDAC_NONE;
-    }
+    return  desc ? desc->tvdac : DISPLAY_TVDAC_NONE;
 }
       
 /*
@@ -500,7 +695,7 @@ static int  display_gettvstatus(struct display_device_t *dev,int displayno)
     
     if(g_display[displayno].type == DISPLAY_DEVICE_TV)
     {
-        tvstatus   = display_gettvdacstatus(dev);
+        tvstatus   = display_readtvdacstatus(ctx);
         tvtype     = display_gettvtype(g_display[displayno].tvformat);
         if((tvstatus == tvtype)&&(tvstatus != DISPLAY_TVDAC_NONE))
         {
@@ -537,10 +732,10 @@ static int display_gethotplug(struct display_device_t *dev,int displayno)
 	}
     else if(g_display[displayno].type == DISPLAY_DEVICE_HDMI)
     {
-        g_display[displayno].hotplug    = display_gethdmistatus(dev);
+        g_display[displayno].hotplug    = display_readhdmistatus((struct display_context_t*)dev);
     }
 
-    return  0;
+    return  g_display[displayno].hotplug;
 }
 
 static int get_g2dpixelformat(int red_size,int red_offset,
@@ -548,108 +743,429 @@ static int get_g2dpixelformat(int red_size,int red_offset,
                               int blue_size,int blue_offset,
                               int alpha_size,int alpha_offset)
 {
-    if((red_size == 8) && (red_offset = 0)
-       && (green_size == 8) && (green_offset = 8)
-       && (blue_size == 8) && (blue_offset = 16)
-       && (alpha_size == 8) && (alpha_offset = 24))
-    {
-        return G2D_FMT_ABGR_AVUY8888;
-    }
-    else if((red_size == 8) && (red_offset = 16)
-       && (green_size == 8) && (green_offset = 8)
-       && (blue_size == 8) && (blue_offset = 0)
-       && (alpha_size == 8) && (alpha_offset = 24))
-    {
-        return G2D_FMT_ARGB_AYUV8888;
-    }
-    else if((red_size == 8) && (red_offset = 8)
-       && (green_size == 8) && (green_offset = 16)
-       && (blue_size == 8) && (blue_offset = 24)
-       && (alpha_size == 8) && (alpha_offset = 0))
-    {
-        return G2D_FMT_BGRA_VUYA8888;
-    }
-    else if((red_size == 8) && (red_offset = 24)
-       && (green_size == 8) && (green_offset = 16)
-       && (blue_size == 8) && (blue_offset = 8)
-       && (alpha_size == 8) && (alpha_offset = 0))
-    {
-        return G2D_FMT_RGBA_YUVA8888;
-    }
-    else if((red_size == 8) && (red_offset = 16)
-       && (green_size == 8) && (green_offset = 8)
-       && (blue_size == 8) && (blue_offset = 0)
-       && (alpha_size == 0) && (alpha_offset = 24))
-    {
-        return G2D_FMT_XRGB8888;
-    }
-    else if((red_size == 8) && (red_offset = 8)
-       && (green_size == 8) && (green_offset = 16)
-       && (blue_size == 8) && (blue_offset = 24)
-       && (alpha_size == 0) && (alpha_offset = 0))
-    {
-        return G2D_FMT_BGRX8888;
-    }
-    else if((red_size == 8) && (red_offset = 0)
-       && (green_size == 8) && (green_offset = 8)
-       && (blue_size == 8) && (blue_offset = 16)
-       && (alpha_size == 0) && (alpha_offset = 24))
-    {
-        return G2D_FMT_XBGR8888;
-    }
-    else if((red_size == 8) && (red_offset = 24)
-       && (green_size == 8) && (green_offset = 16)
-       && (blue_size == 8) && (blue_offset = 8)
-       && (alpha_size == 0) && (alpha_offset = 0))
+    if((red_size == 8) && (green_size == 8) && (blue_size == 8))
     {
-        return G2D_FMT_RGBX8888;
-    }
-    else if((red_size == 5) && (red_offset = 11)
-       && (green_size == 6) && (green_offset = 5)
-       && (blue_size == 5) && (blue_offset = 0))
-    {
-        return G2D_FMT_RGB565;
-    }
-    else if((red_size == 5) && (red_offset = 0)
-       && (green_size == 6) && (green_offset = 5)
-       && (blue_size == 5) && (blue_offset = 11))
-    {
-        return G2D_FMT_BGR565;
+        if(alpha_size == 8)
+        {
+            if((red_offset == 0) && (green_offset == 8) && (blue_offset == 16) && (alpha_offset == 24))
+            {
+                return G2D_FMT_ABGR_AVUY8888;
+            }
+            else if((red_offset == 16) && (green_offset == 8) && (blue_offset == 0) && (alpha_offset == 24))
+            {
+                return G2D_FMT_ARGB_AYUV8888;
+            }
+            else if((red_offset == 8) && (green_offset == 16) && (blue_offset == 24) && (alpha_offset == 0))
+            {
+                return G2D_FMT_BGRA_VUYA8888;
+            }
+            else if((red_offset == 24) && (green_offset == 16) && (blue_offset == 8) && (alpha_offset == 0))
+            {
+                return G2D_FMT_RGBA_YUVA8888;
+            }
+        }
+        else if(alpha_size == 0)
+        {
+            if((red_offset == 16) && (green_offset == 8) && (blue_offset == 0))
+            {
+                return G2D_FMT_XRGB8888;
+            }
+            else if((red_offset == 8) && (green_offset == 16) && (blue_offset == 24))
+            {
+                return G2D_FMT_BGRX8888;
+            }
+            else if((red_offset == 0) && (green_offset == 8) && (blue_offset == 16))
+            {
+                return G2D_FMT_XBGR8888;
+            }
+            else if((red_offset == 24) && (green_offset == 16) && (blue_offset == 8))
+            {
+                return G2D_FMT_RGBX8888;
+            }
+        }
     }
-    else 
+    else if((red_size == 5) && (green_size == 6) && (blue_size == 5) && (green_offset == 5))
     {
-        return G2D_FMT_RGBA_YUVA8888;
+        if((red_offset == 11) && (blue_offset == 0))
+        {
+            return G2D_FMT_RGB565;
+        }
+        else if((red_offset == 0) && (blue_offset == 11))
+        {
+            return G2D_FMT_BGR565;
+        }
     }
+
+    return -1;
 }
-      
+
 /*
 **********************************************************************************************************************
-*                                               display_copyfb
+*                                               display_getg2dformat
 *
 * author:           
 *
-* date:             2011-7-17:11:22:54
+* date:             2026-10-17:10:12:0
 *
-* Description:      copy from src fb to dst fb 
+* Description:      map the channel layout of a framebuffer to the g2d format that describes its memory
 *
-* parameters:       
+* parameters:       var: screen info read back from the fb driver
 *
-* return:           if success return GUI_RET_OK
-*                   if fail return the number of fail
+* return:           g2d format, -1 if the layout has no g2d equivalent
 * modify history: 
 **********************************************************************************************************************
 */
 
-static int display_copyfb(struct display_device_t *dev,int srcfb_id,int srcfb_bufno,
-                          int dstfb_id,int dstfb_bufno)
+static int display_getg2dformat(const struct fb_var_screeninfo *var)
 {
-    struct 	display_context_t*  ctx = (struct display_context_t*)dev;
-    
-	struct fb_fix_screeninfo    fix_src;
-    struct fb_fix_screeninfo    fix_dst;
-    struct fb_var_screeninfo    var_src;
-    struct fb_var_screeninfo    var_dst;
-    char               			node_src[20];
+    if((var->bits_per_pixel != 16) && (var->bits_per_pixel != 32))
+    {
+        return -1;
+    }
+
+    return get_g2dpixelformat(var->red.length,var->red.offset,
+                              var->green.length,var->green.offset,
+                              var->blue.length,var->blue.offset,
+                              var->transp.length,var->transp.offset);
+}
+      
+/*
+**********************************************************************************************************************
+*                                               display_getscnrect
+*
+* author:           
+*
+* date:             2026-10-17:20:10:0
+*
+* Description:      where a screen shows its picture: the overscan set by the user if any, otherwise the safe area
+*                   of the format centered in the output
+*
+* parameters:       displayno: screen, output/valid: output size and safe area of its format
+*
+* return:           
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static void display_getscnrect(int displayno,int output_width,int output_height,int valid_width,int valid_height,
+                               __disp_rect_t *rect)
+{
+    const struct display_overscan_t *overscan = &g_overscan[displayno];
+
+    if(overscan->enabled)
+    {
+        rect->x         = output_width * overscan->left / 100;
+        rect->y         = output_height * overscan->top / 100;
+        rect->width     = output_width - rect->x - output_width * overscan->right / 100;
+        rect->height    = output_height - rect->y - output_height * overscan->bottom / 100;
+    }
+    else
+    {
+        rect->x         = (output_width - valid_width)>>1;
+        rect->y         = (output_height - valid_height)>>1;
+        rect->width     = valid_width;
+        rect->height    = valid_height;
+    }
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_getdispfbformat
+*
+* author:           
+*
+* date:             2026-10-17:10:40:0
+*
+* Description:      describe the memory of a framebuffer in display engine layer terms
+*
+* parameters:       var: screen info of the fb, fb: layer fb description to fill
+*
+* return:           if success return 0
+*                   if the layout can not be scanned out by a layer return -1
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_getdispfbformat(const struct fb_var_screeninfo *var,__disp_fb_t *fb)
+{
+    if((var->bits_per_pixel == 32) && (var->green.offset == 8)
+       && (((var->red.offset == 16) && (var->blue.offset == 0)) || ((var->red.offset == 0) && (var->blue.offset == 16))))
+    {
+        fb->format  = DISP_FORMAT_ARGB8888;
+        fb->seq     = DISP_SEQ_ARGB;
+        fb->br_swap = (var->red.offset == 0);
+    }
+    else if((var->bits_per_pixel == 16) && (var->green.length == 6) && (var->green.offset == 5))
+    {
+        fb->format  = DISP_FORMAT_RGB565;
+        fb->seq     = DISP_SEQ_P10;
+        fb->br_swap = (var->red.offset == 0);
+    }
+    else
+    {
+        return -1;
+    }
+
+    fb->mode        = DISP_MOD_INTERLEAVED;
+    fb->cs_mode     = DISP_BT601;
+    fb->b_trd_src   = false;
+
+    return 0;
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_requestclone
+*
+* author:           
+*
+* date:             2026-10-17:10:40:0
+*
+* Description:      mirror the master framebuffer on a secondary screen without a copy: a scaler layer is requested
+*                   on the secondary screen and pointed at the memory of the master fb, the layer scaler handles the
+*                   size difference and the pan path moves its source window along with the master buffer
+*
+* parameters:       displayno: secondary screen, srcfb_id: master fb, para: output/valid size of the secondary screen,
+*                   width and height are updated to the size of the scanned out buffer on success
+*
+* return:           if success return 0
+*                   if clone is not possible (layout, scale ratio, no free layer) return -1, nothing is changed
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_requestclone(struct display_context_t* ctx,int displayno,int srcfb_id,struct display_fbpara_t *para)
+{
+    struct fb_fix_screeninfo    fix;
+    struct fb_var_screeninfo    var;
+    __disp_layer_info_t         layer_para;
+    unsigned long               args[4];
+    unsigned long               hdl;
+    char                        node[20];
+
+    if(g_clone.hdl)
+    {
+        LOGE("clone layer already requested on screen %d\n",g_clone.screen);
+
+        return  -1;
+    }
+
+    sprintf(node, "/dev/graphics/fb%d", srcfb_id);
+
+    if(ctx->mFD_fb[srcfb_id] == 0)
+    {
+    	ctx->mFD_fb[srcfb_id]			= open(node,O_RDWR,0);
+    	if(ctx->mFD_fb[srcfb_id] <= 0)
+    	{
+    		LOGE("open fb%d fail!\n",srcfb_id);
+    		
+    		ctx->mFD_fb[srcfb_id]		= 0;
+    		
+    		return  -1;
+    	}
+	}
+
+	ioctl(ctx->mFD_fb[srcfb_id],FBIOGET_FSCREENINFO,&fix);
+	ioctl(ctx->mFD_fb[srcfb_id],FBIOGET_VSCREENINFO,&var);
+
+    memset(&layer_para,0,sizeof(layer_para));
+    if(display_getdispfbformat(&var,&layer_para.fb) != 0)
+    {
+        LOGD("fb%d layout can not be cloned, bpp = %d\n",srcfb_id,var.bits_per_pixel);
+
+        return  -1;
+    }
+
+    /* beyond this ratio the layer scaler drops lines, the blit path looks better */
+    if(((uint32_t)para->valid_width * DISPLAY_CLONE_MAX_DOWNSCALE < var.xres)
+       || ((uint32_t)para->valid_height * DISPLAY_CLONE_MAX_DOWNSCALE < var.yres))
+    {
+        LOGD("clone scale %dx%d -> %dx%d out of range\n",var.xres,var.yres,para->valid_width,para->valid_height);
+
+        return  -1;
+    }
+
+    args[0]                         = displayno;
+    args[1]                         = DISP_LAYER_WORK_MODE_SCALER;
+    hdl = ioctl(ctx->mFD_disp,DISP_CMD_LAYER_REQUEST,(unsigned long)args);
+    if(hdl == 0)
+    {
+        LOGD("no scaler layer left on screen %d for clone\n",displayno);
+
+        return  -1;
+    }
+
+    layer_para.mode                 = DISP_LAYER_WORK_MODE_SCALER;
+    layer_para.pipe                 = 0;
+    layer_para.prio                 = 0;
+    layer_para.alpha_en             = 1;
+    layer_para.alpha_val            = 0xff;
+    layer_para.ck_enable            = 0;
+    layer_para.fb.addr[0]           = fix.smem_start;
+    layer_para.fb.size.width        = fix.line_length / (var.bits_per_pixel >> 3);
+    layer_para.fb.size.height       = var.yres_virtual;
+    layer_para.src_win.x            = 0;
+    layer_para.src_win.y            = var.yoffset;
+    layer_para.src_win.width        = var.xres;
+    layer_para.src_win.height       = var.yres;
+    display_getscnrect(displayno,para->output_width,para->output_height,para->valid_width,para->valid_height,&layer_para.scn_win);
+
+    args[0]                         = displayno;
+    args[1]                         = hdl;
+    args[2]                         = (unsigned long)&layer_para;
+    ioctl(ctx->mFD_disp,DISP_CMD_LAYER_SET_PARA,(unsigned long)args);
+
+    args[0]                         = displayno;
+    args[1]                         = hdl;
+    ioctl(ctx->mFD_disp,DISP_CMD_LAYER_TOP,(unsigned long)args);
+
+    args[0]                         = displayno;
+    args[1]                         = hdl;
+    ioctl(ctx->mFD_disp,DISP_CMD_LAYER_OPEN,(unsigned long)args);
+
+    g_clone.hdl                     = hdl;
+    g_clone.screen                  = displayno;
+    g_clone.srcfb                   = srcfb_id;
+    g_clone.xres                    = var.xres;
+    g_clone.yres                    = var.yres;
+
+    para->width                     = var.xres;
+    para->height                    = var.yres;
+
+    LOGD("screen %d clones fb%d, %dx%d -> %dx%d\n",displayno,srcfb_id,var.xres,var.yres,para->valid_width,para->valid_height);
+
+    return  0;
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_releaseclone
+*
+* author:           
+*
+* date:             2026-10-17:10:40:0
+*
+* Description:      stop scanning out the master framebuffer on the secondary screen
+*
+* parameters:       
+*
+* return:           if success return 0
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_releaseclone(struct display_context_t* ctx)
+{
+    unsigned long               args[4];
+
+    if(g_clone.hdl == 0)
+    {
+        return  0;
+    }
+
+    args[0]                         = g_clone.screen;
+    args[1]                         = g_clone.hdl;
+    ioctl(ctx->mFD_disp,DISP_CMD_LAYER_CLOSE,(unsigned long)args);
+
+    args[0]                         = g_clone.screen;
+    args[1]                         = g_clone.hdl;
+    ioctl(ctx->mFD_disp,DISP_CMD_LAYER_RELEASE,(unsigned long)args);
+
+    g_clone.hdl                     = 0;
+
+    return  0;
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_panclone
+*
+* author:           
+*
+* date:             2026-10-17:10:40:0
+*
+* Description:      point the clone layer at buffer bufno of the master framebuffer
+*
+* parameters:       
+*
+* return:           if success return 0
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_panclone(struct display_context_t* ctx,int bufno)
+{
+    __disp_rect_t               src_win;
+    unsigned long               args[4];
+
+    src_win.x                       = 0;
+    src_win.y                       = bufno * g_clone.yres;
+    src_win.width                   = g_clone.xres;
+    src_win.height                  = g_clone.yres;
+
+    args[0]                         = g_clone.screen;
+    args[1]                         = g_clone.hdl;
+    args[2]                         = (unsigned long)&src_win;
+
+    return ioctl(ctx->mFD_disp,DISP_CMD_LAYER_SET_SRC_WINDOW,(unsigned long)args);
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_setclonerect
+*
+* author:           
+*
+* date:             2026-10-17:10:40:0
+*
+* Description:      move the clone layer after the secondary output changed its mode
+*
+* parameters:       
+*
+* return:           if success return 0
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_setclonerect(struct display_context_t* ctx,const __disp_rect_t *scn_win)
+{
+    unsigned long               args[4];
+
+    args[0]                         = g_clone.screen;
+    args[1]                         = g_clone.hdl;
+    args[2]                         = (unsigned long)scn_win;
+
+    return ioctl(ctx->mFD_disp,DISP_CMD_LAYER_SET_SCN_WINDOW,(unsigned long)args);
+}
+      
+/*
+**********************************************************************************************************************
+*                                               display_copyfb
+*
+* author:           
+*
+* date:             2011-7-17:11:22:54
+*
+* Description:      copy from src fb to dst fb 
+*
+* parameters:       
+*
+* return:           if success return GUI_RET_OK
+*                   if fail return the number of fail
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_copyfb(struct display_device_t *dev,int srcfb_id,int srcfb_bufno,
+                          int dstfb_id,int dstfb_bufno)
+{
+    struct 	display_context_t*  ctx = (struct display_context_t*)dev;
+    
+	struct fb_fix_screeninfo    fix_src;
+    struct fb_fix_screeninfo    fix_dst;
+    struct fb_var_screeninfo    var_src;
+    struct fb_var_screeninfo    var_dst;
+    char               			node_src[20];
     char               			node_dst[20];
     unsigned int                src_width;
     unsigned int                src_height;
@@ -658,9 +1174,23 @@ static int display_copyfb(struct display_device_t *dev,int srcfb_id,int srcfb_bu
     unsigned int                addr_src;
     unsigned int                addr_dst;
     unsigned int                size;
+    int                         src_format;
+    int                         dst_format;
     g2d_stretchblt              blit_para;
     int                         err;
     
+    if(g_clone.hdl && (srcfb_id == g_clone.srcfb))
+    {
+        /* the secondary screen scans out the master fb itself, follow the buffer instead of copying it */
+        return  display_panclone(ctx,srcfb_bufno);
+    }
+
+    if(g_secondary.released && (dstfb_id == 1))
+    {
+        /* fb1 is freed while its screen is unplugged */
+        return  0;
+    }
+
     sprintf(node_src, "/dev/graphics/fb%d", srcfb_id);
 
     if(ctx->mFD_fb[srcfb_id] == 0)
@@ -726,40 +1256,30 @@ static int display_copyfb(struct display_device_t *dev,int srcfb_id,int srcfb_bu
 	//LOGD("addr_src = %x\n",addr_src);
     //LOGD("addr_dst = %x\n",addr_dst);
     //LOGD("size = %d\n",size);
-	switch (var_src.bits_per_pixel) 
-	{			
-    	case 16:
-    		blit_para.src_image.format      = G2D_FMT_RGB565;
-    		break;
-    		
-    	case 24:
-    		blit_para.src_image.format      = G2D_FMT_RGBA_YUVA8888;
-    		break;
-    		
-    	case 32:
-    		blit_para.src_image.format      = G2D_FMT_RGBA_YUVA8888;
-    		break;
-    		
-    	default:
-    	    LOGE("invalid bits_per_pixel :%d\n", var_src.bits_per_pixel);
-    		return -1;
-	}
+    src_format  = display_getg2dformat(&var_src);
+    dst_format  = display_getg2dformat(&var_dst);
+    if((src_format < 0) || (dst_format < 0))
+    {
+        LOGE("unsupported fb layout: src %dbpp, dst %dbpp\n", var_src.bits_per_pixel, var_dst.bits_per_pixel);
+
+        return -1;
+    }
 
     blit_para.src_image.addr[0]     = addr_src;
     blit_para.src_image.addr[1]     = 0;
     blit_para.src_image.addr[2]     = 0;
-    blit_para.src_image.format      = G2D_FMT_ARGB_AYUV8888;
+    blit_para.src_image.format      = (g2d_data_fmt)src_format;
     blit_para.src_image.h           = src_height;
     blit_para.src_image.w           = src_width;
-    blit_para.src_image.pixel_seq   = G2D_SEQ_VYUY;
+    blit_para.src_image.pixel_seq   = G2D_SEQ_NORMAL;
 
     blit_para.dst_image.addr[0]     = addr_dst;
     blit_para.dst_image.addr[1]     = 0;
     blit_para.dst_image.addr[2]     = 0;
-    blit_para.dst_image.format      = G2D_FMT_ARGB_AYUV8888;
+    blit_para.dst_image.format      = (g2d_data_fmt)dst_format;
     blit_para.dst_image.h           = dst_height;
     blit_para.dst_image.w           = dst_width;
-    blit_para.dst_image.pixel_seq   = G2D_SEQ_VYUY;
+    blit_para.dst_image.pixel_seq   = G2D_SEQ_NORMAL;
 
     //blit_para.dst_x                 = 0;
     //blit_para.dst_y                 = 0;
@@ -822,6 +1342,8 @@ static int display_copyfbsoft(struct display_device_t *dev,int srcfb_id,int srcf
     unsigned int                addr_src;
     unsigned int                addr_dst;
     unsigned int                size;
+    int                         src_format;
+    int                         dst_format;
     g2d_stretchblt              blit_para;
     int                         err;
     
@@ -877,40 +1399,30 @@ static int display_copyfbsoft(struct display_device_t *dev,int srcfb_id,int srcf
 	//LOGD("addr_src = %x\n",addr_src);
     //LOGD("addr_dst = %x\n",addr_dst);
     //LOGD("size = %d\n",size);
-	switch (var_src.bits_per_pixel) 
-	{			
-    	case 16:
-    		blit_para.src_image.format      = G2D_FMT_RGB565;
-    		break;
-    		
-    	case 24:
-    		blit_para.src_image.format      = G2D_FMT_RGBA_YUVA8888;
-    		break;
-    		
-    	case 32:
-    		blit_para.src_image.format      = G2D_FMT_RGBA_YUVA8888;
-    		break;
-    		
-    	default:
-    	    LOGE("invalid bits_per_pixel :%d\n", var_src.bits_per_pixel);
-    		return -1;
-	}
+    src_format  = display_getg2dformat(&var_src);
+    dst_format  = display_getg2dformat(&var_dst);
+    if((src_format < 0) || (dst_format < 0))
+    {
+        LOGE("unsupported fb layout: src %dbpp, dst %dbpp\n", var_src.bits_per_pixel, var_dst.bits_per_pixel);
+
+        return -1;
+    }
 
     blit_para.src_image.addr[0]     = addr_src;
     blit_para.src_image.addr[1]     = 0;
     blit_para.src_image.addr[2]     = 0;
-    blit_para.src_image.format      = G2D_FMT_ARGB_AYUV8888;
+    blit_para.src_image.format      = (g2d_data_fmt)src_format;
     blit_para.src_image.h           = src_height;
     blit_para.src_image.w           = src_width;
-    blit_para.src_image.pixel_seq   = G2D_SEQ_VYUY;
+    blit_para.src_image.pixel_seq   = G2D_SEQ_NORMAL;
 
     blit_para.dst_image.addr[0]     = addr_dst;
     blit_para.dst_image.addr[1]     = 0;
     blit_para.dst_image.addr[2]     = 0;
-    blit_para.dst_image.format      = G2D_FMT_ARGB_AYUV8888;
+    blit_para.dst_image.format      = (g2d_data_fmt)dst_format;
     blit_para.dst_image.h           = dst_height;
     blit_para.dst_image.w           = dst_width;
-    blit_para.dst_image.pixel_seq   = G2D_SEQ_VYUY;
+    blit_para.dst_image.pixel_seq   = G2D_SEQ_NORMAL;
 
     //blit_para.dst_x                 = 0;
     //blit_para.dst_y                 = 0;
@@ -961,6 +1473,17 @@ static int display_pandisplay(struct display_device_t *dev,int fb_id,int bufno)
     struct fb_var_screeninfo    var;
     char               node[20];
     
+    if(g_clone.hdl && (fb_id != g_clone.srcfb))
+    {
+        /* no secondary fb while cloning, the clone layer follows the master pan */
+        return  0;
+    }
+
+    if(g_secondary.released && (fb_id == 1))
+    {
+        return  0;
+    }
+
     sprintf(node, "/dev/graphics/fb%d", fb_id);
     
     if(ctx->mFD_fb[fb_id] == 0)
@@ -981,6 +1504,11 @@ static int display_pandisplay(struct display_device_t *dev,int fb_id,int bufno)
 	//LOGD("fb_id = %d,var.yoffset = %d\n",fb_id,var.yoffset);
 	ioctl(ctx->mFD_fb[fb_id],FBIOPAN_DISPLAY,&var);
 
+    if(g_clone.hdl)
+    {
+        display_panclone(ctx,bufno);
+    }
+
     return 0;
 }
       
@@ -1004,43 +1532,9 @@ static int display_pandisplay(struct display_device_t *dev,int fb_id,int bufno)
 
 static int get_tvformat(int format) 
 {
-    switch (format) 
-    {
-	    case DISPLAY_TVFORMAT_480I:       				return DISP_TV_MOD_480I;           
-	    case DISPLAY_TVFORMAT_480P:     				return DISP_TV_MOD_480P;    	    
-	    case DISPLAY_TVFORMAT_576I:     				return DISP_TV_MOD_576I;     	    
-	    case DISPLAY_TVFORMAT_576P:  					return DISP_TV_MOD_576P;  		    
-	    case DISPLAY_TVFORMAT_720P_50HZ:  				return DISP_TV_MOD_720P_50HZ;      
-	    case DISPLAY_TVFORMAT_720P_60HZ:       			return DISP_TV_MOD_720P_60HZ;      
-	    case DISPLAY_TVFORMAT_1080I_50HZ:     			return DISP_TV_MOD_1080I_50HZ;     
-	    case DISPLAY_TVFORMAT_1080I_60HZ:       		return DISP_TV_MOD_1080I_60HZ;     
-	    case DISPLAY_TVFORMAT_1080P_50HZ:     			return DISP_TV_MOD_1080P_50HZ;     
-	    case DISPLAY_TVFORMAT_1080P_60HZ:     			return DISP_TV_MOD_1080P_60HZ;     
-	    case DISPLAY_TVFORMAT_1080P_24HZ:  				return DISP_TV_MOD_1080P_24HZ;   
-	    case DISPLAY_TVFORMAT_NTSC:       				return DISP_TV_MOD_NTSC;  
-	    case DISPLAY_TVFORMAT_NTSC_SVIDEO:      		return DISP_TV_MOD_NTSC_SVIDEO;   
-		case DISPLAY_TVFORMAT_PAL:       				return DISP_TV_MOD_PAL;  
-	    case DISPLAY_TVFORMAT_PAL_SVIDEO:      			return DISP_TV_MOD_PAL_SVIDEO;   	 
-		case DISPLAY_TVFORMAT_PAL_M:     				return DISP_TV_MOD_PAL_M;    	 
-		case DISPLAY_TVFORMAT_PAL_M_SVIDEO:     		return DISP_TV_MOD_PAL_M_SVIDEO;     	
-		case DISPLAY_TVFORMAT_PAL_NC:     				return DISP_TV_MOD_PAL_NC;    	 
-		case DISPLAY_TVFORMAT_PAL_NC_SVIDEO:     		return DISP_TV_MOD_PAL_NC_SVIDEO; 
-		case DISPLAY_VGA_H1680_V1050:					return DISP_VGA_H1680_V1050;   
-	    case DISPLAY_VGA_H1440_V900:                    return DISP_VGA_H1440_V900;    
-	    case DISPLAY_VGA_H1360_V768:                    return DISP_VGA_H1360_V768;    
-	    case DISPLAY_VGA_H1280_V1024:                   return DISP_VGA_H1280_V1024;  
-	    case DISPLAY_VGA_H1024_V768:                    return DISP_VGA_H1024_V768;    
-	    case DISPLAY_VGA_H800_V600:                     return DISP_VGA_H800_V600;     
-	    case DISPLAY_VGA_H640_V480:                     return DISP_VGA_H640_V480;    
-	    case DISPLAY_VGA_H1440_V900_RB:                 return DISP_VGA_H1440_V900_RB;
-	    case DISPLAY_VGA_H1680_V1050_RB:                return DISP_VGA_H1680_V1050_RB;
-	    case DISPLAY_VGA_H1920_V1080_RB:                return DISP_VGA_H1920_V1080_RB;
-	    case DISPLAY_VGA_H1920_V1080:                   return DISP_VGA_H1920_V1080;   
-	    case DISPLAY_VGA_H1280_V720:                    return DISP_VGA_H1280_V720;    
-		default:										break;  
-	 
-    }       
-    return -1;
+    const struct display_modedesc_t *desc = display_findmode(format);
+
+    return  desc ? desc->driver : -1;
 } 
 
 
@@ -1081,45 +1575,11 @@ static int get_pixelformat(int format)
 
 static int  display_getwidth(struct display_context_t* ctx,int displayno,int format)
 {
-    switch (format) 
+    const struct display_modedesc_t *desc = display_findmode(format);
+
+    if(desc)
     {
-	    case DISPLAY_TVFORMAT_480I:       				return 720;           
-	    case DISPLAY_TVFORMAT_480P:     				return 720;    	    
-	    case DISPLAY_TVFORMAT_576I:     				return 720;     	    
-	    case DISPLAY_TVFORMAT_576P:  					return 720;  		    
-	    case DISPLAY_TVFORMAT_720P_50HZ:  				return 1280;      
-	    case DISPLAY_TVFORMAT_720P_60HZ:       			return 1280;      
-	    case DISPLAY_TVFORMAT_1080I_50HZ:     			return 1920;     
-	    case DISPLAY_TVFORMAT_1080I_60HZ:       		return 1920;     
-	    case DISPLAY_TVFORMAT_1080P_50HZ:     			return 1920;     
-	    case DISPLAY_TVFORMAT_1080P_60HZ:     			return 1920;     
-	    case DISPLAY_TVFORMAT_1080P_24HZ:  				return 1920;   
-	    case DISPLAY_TVFORMAT_NTSC:       				return 720;  
-	    case DISPLAY_TVFORMAT_NTSC_SVIDEO:      		return 720;   	       
-		case DISPLAY_TVFORMAT_NTSC_CVBS_SVIDEO: 		return 720;     		
-		case DISPLAY_TVFORMAT_PAL:       				return 720;  
-	    case DISPLAY_TVFORMAT_PAL_SVIDEO:      			return 720;   	       
-		case DISPLAY_TVFORMAT_PAL_CVBS_SVIDEO: 			return 720;      
-		case DISPLAY_TVFORMAT_PAL_M:     				return 720;    	 
-		case DISPLAY_TVFORMAT_PAL_M_SVIDEO:     		return 720;     	 
-		case DISPLAY_TVFORMAT_PAL_M_CVBS_SVIDEO:  		return 720;  		 
-		case DISPLAY_TVFORMAT_PAL_NC:     				return 720;    	 
-		case DISPLAY_TVFORMAT_PAL_NC_SVIDEO:     		return 720;     	 
-		case DISPLAY_TVFORMAT_PAL_NC_CVBS_SVIDEO:  		return 720;  
-		case DISPLAY_VGA_H1680_V1050:					return 1680;   
-	    case DISPLAY_VGA_H1440_V900:                    return 1440;    
-	    case DISPLAY_VGA_H1360_V768:                    return 1360;    
-	    case DISPLAY_VGA_H1280_V1024:                   return 1280;   
-	    case DISPLAY_VGA_H1024_V768:                    return 1024;    
-	    case DISPLAY_VGA_H800_V600:                     return 800;     
-	    case DISPLAY_VGA_H640_V480:                     return 640;     
-	    case DISPLAY_VGA_H1440_V900_RB:                 return 1440; 
-	    case DISPLAY_VGA_H1680_V1050_RB:                return 1680;
-	    case DISPLAY_VGA_H1920_V1080_RB:                return 1920;
-	    case DISPLAY_VGA_H1920_V1080:                   return 1920;   
-	    case DISPLAY_VGA_H1280_V720:                    return 1280;    
-		default:										break;  
-	 
+        return  desc->info.width;
     }
 
     if(format == DISPLAY_DEFAULT)
@@ -1134,48 +1594,13 @@ static int  display_getwidth(struct display_context_t* ctx,int displayno,int for
     return -1;
 }
 
-#if 1
 static int  display_getvalidwidth(struct display_context_t* ctx,int displayno,int format)
 {
-    switch (format) 
+    const struct display_modedesc_t *desc = display_findmode(format);
+
+    if(desc)
     {
-	    case DISPLAY_TVFORMAT_480I:       				return 660;           
-	    case DISPLAY_TVFORMAT_480P:     				return 660;    	    
-	    case DISPLAY_TVFORMAT_576I:     				return 660;     	    
-	    case DISPLAY_TVFORMAT_576P:  					return 660;  		    
-	    case DISPLAY_TVFORMAT_720P_50HZ:  				return 1220;      
-	    case DISPLAY_TVFORMAT_720P_60HZ:       			return 1220;      
-	    case DISPLAY_TVFORMAT_1080I_50HZ:     			return 1840;     
-	    case DISPLAY_TVFORMAT_1080I_60HZ:       		return 1840;     
-	    case DISPLAY_TVFORMAT_1080P_50HZ:     			return 1840;     
-	    case DISPLAY_TVFORMAT_1080P_60HZ:     			return 1840;     
-	    case DISPLAY_TVFORMAT_1080P_24HZ:  				return 1840;   
-	    case DISPLAY_TVFORMAT_NTSC:       				return 660;  
-	    case DISPLAY_TVFORMAT_NTSC_SVIDEO:      		return 660;   	       
-		case DISPLAY_TVFORMAT_NTSC_CVBS_SVIDEO: 		return 660;     		
-		case DISPLAY_TVFORMAT_PAL:       				return 660;  
-	    case DISPLAY_TVFORMAT_PAL_SVIDEO:      			return 660;   	       
-		case DISPLAY_TVFORMAT_PAL_CVBS_SVIDEO: 			return 660;      
-		case DISPLAY_TVFORMAT_PAL_M:     				return 660;    	 
-		case DISPLAY_TVFORMAT_PAL_M_SVIDEO:     		return 660;     	 
-		case DISPLAY_TVFORMAT_PAL_M_CVBS_SVIDEO:  		return 660;  		 
-		case DISPLAY_TVFORMAT_PAL_NC:     				return 660;    	 
-		case DISPLAY_TVFORMAT_PAL_NC_SVIDEO:     		return 660;     	 
-		case DISPLAY_TVFORMAT_PAL_NC_CVBS_SVIDEO:  		return 660;  
-		case DISPLAY_VGA_H1680_V1050:					return 1680;   
-	    case DISPLAY_VGA_H1440_V900:                    return 1440;    
-	    case DISPLAY_VGA_H1360_V768:                    return 1360;    
-	    case DISPLAY_VGA_H1280_V1024:                   return 1280;   
-	    case DISPLAY_VGA_H1024_V768:                    return 1024;    
-	    case DISPLAY_VGA_H800_V600:                     return 800;     
-	    case DISPLAY_VGA_H640_V480:                     return 640;     
-	    case DISPLAY_VGA_H1440_V900_RB:                 return 1440; 
-	    case DISPLAY_VGA_H1680_V1050_RB:                return 1680;
-	    case DISPLAY_VGA_H1920_V1080_RB:                return 1920;
-	    case DISPLAY_VGA_H1920_V1080:                   return 1920;   
-	    case DISPLAY_VGA_H1280_V720:                    return 1280;    
-		default:										break;  
-	 
+        return  desc->info.valid_width;
     }
 
     if(format == DISPLAY_DEFAULT)
@@ -1188,63 +1613,7 @@ static int  display_getvalidwidth(struct display_context_t* ctx,int displayno,in
     }
     
     return -1;
-} 
-#else
-static int  display_getvalidwidth(struct display_context_t* ctx,int displayno,int format)
-{
-    switch (format) 
-    {
-	    case DISPLAY_TVFORMAT_480I:       				return 720;           
-	    case DISPLAY_TVFORMAT_480P:     				return 720;    	    
-	    case DISPLAY_TVFORMAT_576I:     				return 720;     	    
-	    case DISPLAY_TVFORMAT_576P:  					return 720;  		    
-	    case DISPLAY_TVFORMAT_720P_50HZ:  				return 1280;      
-	    case DISPLAY_TVFORMAT_720P_60HZ:       			return 1280;      
-	    case DISPLAY_TVFORMAT_1080I_50HZ:     			return 1920;     
-	    case DISPLAY_TVFORMAT_1080I_60HZ:       		return 1920;     
-	    case DISPLAY_TVFORMAT_1080P_50HZ:     			return 1920;     
-	    case DISPLAY_TVFORMAT_1080P_60HZ:     			return 1920;     
-	    case DISPLAY_TVFORMAT_1080P_24HZ:  				return 1920;   
-	    case DISPLAY_TVFORMAT_NTSC:       				return 720;  
-	    case DISPLAY_TVFORMAT_NTSC_SVIDEO:      		return 720;   	       
-		case DISPLAY_TVFORMAT_NTSC_CVBS_SVIDEO: 		return 720;     		
-		case DISPLAY_TVFORMAT_PAL:       				return 720;  
-	    case DISPLAY_TVFORMAT_PAL_SVIDEO:      			return 720;   	       
-		case DISPLAY_TVFORMAT_PAL_CVBS_SVIDEO: 			return 720;      
-		case DISPLAY_TVFORMAT_PAL_M:     				return 720;    	 
-		case DISPLAY_TVFORMAT_PAL_M_SVIDEO:     		return 720;     	 
-		case DISPLAY_TVFORMAT_PAL_M_CVBS_SVIDEO:  		return 720;  		 
-		case DISPLAY_TVFORMAT_PAL_NC:     				return 720;    	 
-		case DISPLAY_TVFORMAT_PAL_NC_SVIDEO:     		return 720;     	 
-		case DISPLAY_TVFORMAT_PAL_NC_CVBS_SVIDEO:  		return 720;  
-		case DISPLAY_VGA_H1680_V1050:					return 1680;   
-	    case DISPLAY_VGA_H1440_V900:                    return 1440;    
-	    case DISPLAY_VGA_H1360_V768:                    return 1360;    
-	    case DISPLAY_VGA_H1280_V1024:                   return 1280;   
-	    case DISPLAY_VGA_H1024_V768:                    return 1024;    
-	    case DISPLAY_VGA_H800_V600:                     return 800;     
-	    case DISPLAY_VGA_H640_V480:                     return 640;     
-	    case DISPLAY_VGA_H1440_V900_RB:                 return 1440; 
-	    case DISPLAY_VGA_H1680_V1050_RB:                return 1680;
-	    case DISPLAY_VGA_H1920_V1080_RB:                return 1920;
-	    case DISPLAY_VGA_H1920_V1080:                   return 1920;   
-	    case DISPLAY_VGA_H1280_V720:                    return 1280;    
-		default:										break;  
-	 
-    }
-
-    if(format == DISPLAY_DEFAULT)
-    {
-        unsigned long args[4];
-
-        args[0] = displayno;
-        
-        return ioctl(ctx->mFD_disp,DISP_CMD_SCN_GET_WIDTH,args);
-    }
-    
-    return -1;
-} 
-#endif
+}
 /*
 **********************************************************************************************************************
 *                                               display_getheight
@@ -1265,46 +1634,12 @@ static int  display_getvalidwidth(struct display_context_t* ctx,int displayno,in
 
 static int  display_getheight(struct display_context_t* ctx,int displayno,int format)
 {
-    switch (format) 
+    const struct display_modedesc_t *desc = display_findmode(format);
+
+    if(desc)
     {
-	    case DISPLAY_TVFORMAT_480I:       				return 480;           
-	    case DISPLAY_TVFORMAT_480P:     				return 480;    	    
-	    case DISPLAY_TVFORMAT_576I:     				return 576;     	    
-	    case DISPLAY_TVFORMAT_576P:  					return 576;  		    
-	    case DISPLAY_TVFORMAT_720P_50HZ:  				return 720;      
-	    case DISPLAY_TVFORMAT_720P_60HZ:       			return 720;      
-	    case DISPLAY_TVFORMAT_1080I_50HZ:     			return 1080;     
-	    case DISPLAY_TVFORMAT_1080I_60HZ:       		return 1080;     
-	    case DISPLAY_TVFORMAT_1080P_50HZ:     			return 1080;     
-	    case DISPLAY_TVFORMAT_1080P_60HZ:     			return 1080;     
-	    case DISPLAY_TVFORMAT_1080P_24HZ:  				return 1080;   
-	    case DISPLAY_TVFORMAT_NTSC:       				return 480;  
-	    case DISPLAY_TVFORMAT_NTSC_SVIDEO:      		return 480;   	       
-		case DISPLAY_TVFORMAT_NTSC_CVBS_SVIDEO: 		return 480;     		
-		case DISPLAY_TVFORMAT_PAL:       				return 576;  
-	    case DISPLAY_TVFORMAT_PAL_SVIDEO:      			return 576;   	       
-		case DISPLAY_TVFORMAT_PAL_CVBS_SVIDEO: 			return 576;      
-		case DISPLAY_TVFORMAT_PAL_M:     				return 576;    	 
-		case DISPLAY_TVFORMAT_PAL_M_SVIDEO:     		return 576;     	 
-		case DISPLAY_TVFORMAT_PAL_M_CVBS_SVIDEO:  		return 576;  		 
-		case DISPLAY_TVFORMAT_PAL_NC:     				return 576;    	 
-		case DISPLAY_TVFORMAT_PAL_NC_SVIDEO:     		return 576;     	 
-		case DISPLAY_TVFORMAT_PAL_NC_CVBS_SVIDEO:  		return 576;  
-		case DISPLAY_VGA_H1680_V1050:					return 1050;   
-	    case DISPLAY_VGA_H1440_V900:                    return 900;    
-	    case DISPLAY_VGA_H1360_V768:                    return 768;    
-	    case DISPLAY_VGA_H1280_V1024:                   return 1024;   
-	    case DISPLAY_VGA_H1024_V768:                    return 768;    
-	    case DISPLAY_VGA_H800_V600:                     return 600;     
-	    case DISPLAY_VGA_H640_V480:                     return 480;     
-	    case DISPLAY_VGA_H1440_V900_RB:                 return 900;
-	    case DISPLAY_VGA_H1680_V1050_RB:                return 1050;
-	    case DISPLAY_VGA_H1920_V1080_RB:                return 1080;
-	    case DISPLAY_VGA_H1920_V1080:                   return 1080;   
-	    case DISPLAY_VGA_H1280_V720:                    return 720;    
-		default:										break;  
-	 
-    }  
+        return  desc->info.height;
+    }
 
     if(format == DISPLAY_DEFAULT)
     {
@@ -1318,104 +1653,14 @@ static int  display_getheight(struct display_context_t* ctx,int displayno,int fo
     return -1;
 }
 
-#if 1
 static int  display_getvalidheight(struct display_context_t* ctx,int displayno,int format)
 {
-    switch (format) 
-    {
-	    case DISPLAY_TVFORMAT_480I:       				return 440;           
-	    case DISPLAY_TVFORMAT_480P:     				return 440;    	    
-	    case DISPLAY_TVFORMAT_576I:     				return 536;     	    
-	    case DISPLAY_TVFORMAT_576P:  					return 536;  		    
-	    case DISPLAY_TVFORMAT_720P_50HZ:  				return 680;      
-	    case DISPLAY_TVFORMAT_720P_60HZ:       			return 680;      
-	    case DISPLAY_TVFORMAT_1080I_50HZ:     			return 1040;     
-	    case DISPLAY_TVFORMAT_1080I_60HZ:       		return 1040;     
-	    case DISPLAY_TVFORMAT_1080P_50HZ:     			return 1040;     
-	    case DISPLAY_TVFORMAT_1080P_60HZ:     			return 1040;     
-	    case DISPLAY_TVFORMAT_1080P_24HZ:  				return 1040;   
-	    case DISPLAY_TVFORMAT_NTSC:       				return 440;  
-	    case DISPLAY_TVFORMAT_NTSC_SVIDEO:      		return 440;   	       
-		case DISPLAY_TVFORMAT_NTSC_CVBS_SVIDEO: 		return 440;     		
-		case DISPLAY_TVFORMAT_PAL:       				return 536;  
-	    case DISPLAY_TVFORMAT_PAL_SVIDEO:      			return 536;   	       
-		case DISPLAY_TVFORMAT_PAL_CVBS_SVIDEO: 			return 536;      
-		case DISPLAY_TVFORMAT_PAL_M:     				return 536;    	 
-		case DISPLAY_TVFORMAT_PAL_M_SVIDEO:     		return 536;     	 
-		case DISPLAY_TVFORMAT_PAL_M_CVBS_SVIDEO:  		return 536;  		 
-		case DISPLAY_TVFORMAT_PAL_NC:     				return 536;    	 
-		case DISPLAY_TVFORMAT_PAL_NC_SVIDEO:     		return 536;     	 
-		case DISPLAY_TVFORMAT_PAL_NC_CVBS_SVIDEO:  		return 536;  
-		case DISPLAY_VGA_H1680_V1050:					return 1050;   
-	    case DISPLAY_VGA_H1440_V900:                    return 900;    
-	    case DISPLAY_VGA_H1360_V768:                    return 768;    
-	    case DISPLAY_VGA_H1280_V1024:                   return 1024;   
-	    case DISPLAY_VGA_H1024_V768:                    return 768;    
-	    case DISPLAY_VGA_H800_V600:                     return 600;     
-	    case DISPLAY_VGA_H640_V480:                     return 480;     
-	    case DISPLAY_VGA_H1440_V900_RB:                 return 900;
-	    case DISPLAY_VGA_H1680_V1050_RB:                return 1050;
-	    case DISPLAY_VGA_H1920_V1080_RB:                return 1080;
-	    case DISPLAY_VGA_H1920_V1080:                   return 1080;   
-	    case DISPLAY_VGA_H1280_V720:                    return 720;    
-		default:										break;  
-	 
-    }  
+    const struct display_modedesc_t *desc = display_findmode(format);
 
-    if(format == DISPLAY_DEFAULT)
+    if(desc)
     {
-        unsigned long args[4];
-
-        args[0] = displayno;
-        
-        return ioctl(ctx->mFD_disp,DISP_CMD_SCN_GET_HEIGHT,args);
+        return  desc->info.valid_height;
     }
-    
-    return -1;
-}
-#else
-static int  display_getvalidheight(struct display_context_t* ctx,int displayno,int format)
-{
-    switch (format) 
-    {
-	    case DISPLAY_TVFORMAT_480I:       				return 480;           
-	    case DISPLAY_TVFORMAT_480P:     				return 480;    	    
-	    case DISPLAY_TVFORMAT_576I:     				return 576;     	    
-	    case DISPLAY_TVFORMAT_576P:  					return 576;  		    
-	    case DISPLAY_TVFORMAT_720P_50HZ:  				return 720;      
-	    case DISPLAY_TVFORMAT_720P_60HZ:       			return 720;      
-	    case DISPLAY_TVFORMAT_1080I_50HZ:     			return 1080;     
-	    case DISPLAY_TVFORMAT_1080I_60HZ:       		return 1080;     
-	    case DISPLAY_TVFORMAT_1080P_50HZ:     			return 1080;     
-	    case DISPLAY_TVFORMAT_1080P_60HZ:     			return 1080;     
-	    case DISPLAY_TVFORMAT_1080P_24HZ:  				return 1080;   
-	    case DISPLAY_TVFORMAT_NTSC:       				return 480;  
-	    case DISPLAY_TVFORMAT_NTSC_SVIDEO:      		return 480;   	       
-		case DISPLAY_TVFORMAT_NTSC_CVBS_SVIDEO: 		return 480;     		
-		case DISPLAY_TVFORMAT_PAL:       				return 576;  
-	    case DISPLAY_TVFORMAT_PAL_SVIDEO:      			return 576;   	       
-		case DISPLAY_TVFORMAT_PAL_CVBS_SVIDEO: 			return 576;      
-		case DISPLAY_TVFORMAT_PAL_M:     				return 576;    	 
-		case DISPLAY_TVFORMAT_PAL_M_SVIDEO:     		return 576;     	 
-		case DISPLAY_TVFORMAT_PAL_M_CVBS_SVIDEO:  		return 576;  		 
-		case DISPLAY_TVFORMAT_PAL_NC:     				return 576;    	 
-		case DISPLAY_TVFORMAT_PAL_NC_SVIDEO:     		return 576;     	 
-		case DISPLAY_TVFORMAT_PAL_NC_CVBS_SVIDEO:  		return 576;  
-		case DISPLAY_VGA_H1680_V1050:					return 1050;   
-	    case DISPLAY_VGA_H1440_V900:                    return 900;    
-	    case DISPLAY_VGA_H1360_V768:                    return 768;    
-	    case DISPLAY_VGA_H1280_V1024:                   return 1024;   
-	    case DISPLAY_VGA_H1024_V768:                    return 768;    
-	    case DISPLAY_VGA_H800_V600:                     return 600;     
-	    case DISPLAY_VGA_H640_V480:                     return 480;     
-	    case DISPLAY_VGA_H1440_V900_RB:                 return 900;
-	    case DISPLAY_VGA_H1680_V1050_RB:                return 1050;
-	    case DISPLAY_VGA_H1920_V1080_RB:                return 1080;
-	    case DISPLAY_VGA_H1920_V1080:                   return 1080;   
-	    case DISPLAY_VGA_H1280_V720:                    return 720;    
-		default:										break;  
-	 
-    }  
 
     if(format == DISPLAY_DEFAULT)
     {
@@ -1428,7 +1673,6 @@ static int  display_getvalidheight(struct display_context_t* ctx,int displayno,i
     
     return -1;
 }
-#endif
 /*
 **********************************************************************************************************************
 *                                               display_releasefb
@@ -1512,6 +1756,12 @@ static int  display_requestfb(struct display_context_t* ctx,int fb_id,struct dis
     unsigned long 				fb_layer_hdl;
     __disp_colorkey_t 			ck;
     __disp_rect_t				scn_rect;
+
+    if(fb_id == 1)
+    {
+        /* whoever asks for fb1 owns it again, even in a mode left while the hot plug had released it */
+        g_secondary.released    = false;
+    }
     
     sprintf(node, "/dev/graphics/fb%d", fb_id);
 
@@ -1545,9 +1795,11 @@ static int  display_requestfb(struct display_context_t* ctx,int fb_id,struct dis
 	    red_size				= 5;
         green_size				= 6;
         blue_size				= 5;
-        red_offset				= 0;
+        alpha_size				= 0;
+        red_offset				= 11;
         green_offset			= 5;
-        blue_offset				= 11;
+        blue_offset				= 0;
+        alpha_offset			= 0;
         bpp						= 16;
 	}
 	else if(displaypara->format == HAL_PIXEL_FORMAT_BGRA_8888)
@@ -1648,13 +1900,10 @@ static int  display_requestfb(struct display_context_t* ctx,int fb_id,struct dis
     	ioctl(ctx->mFD_fb[fb_id],FBIOGET_LAYER_HDL_0,&fb_layer_hdl);
     }
     
-    if((displaypara->output_height != displaypara->valid_height) || (displaypara->output_width != displaypara->valid_width))
+    display_getscnrect(screen,displaypara->output_width,displaypara->output_height,
+                       displaypara->valid_width,displaypara->valid_height,&scn_rect);
+    if(((int)scn_rect.width != displaypara->output_width) || ((int)scn_rect.height != displaypara->output_height))
     {
-		scn_rect.x			= (displaypara->output_width - displaypara->valid_width)>>1;
-		scn_rect.y			= (displaypara->output_height - displaypara->valid_height)>>1;
-		scn_rect.width		= displaypara->valid_width;
-		scn_rect.height		= displaypara->valid_height;
-		
 		LOGD("scn_rect.width = %d,scn_rect.height = %d,screen = %d,fb_layer_hdl = %d,fb_id = %d\n",scn_rect.width,scn_rect.height,screen,fb_layer_hdl,fb_id);
 		
 		arg[0] 				= screen;
@@ -1722,7 +1971,7 @@ static int  display_requestfb(struct display_context_t* ctx,int fb_id,struct dis
 **********************************************************************************************************************
 */
 
-static int  display_setfbrect(struct display_context_t* ctx,int displayno,int fb_id,int x,int y,int width,int height)
+static int  display_setfbrect(struct display_context_t* ctx,int displayno,int fb_id,const __disp_rect_t *rect)
 {
     __disp_fb_create_para_t 	fb_para;
     struct 						fb_var_screeninfo var;
@@ -1732,6 +1981,17 @@ static int  display_setfbrect(struct display_context_t* ctx,int displayno,int fb
     int							ret = -1;
     unsigned long 				fb_layer_hdl;
     __disp_rect_t				scn_rect;
+
+    if(g_clone.hdl && (g_clone.screen == displayno))
+    {
+        /* fb1 is not there while the screen clones the master fb, move the clone layer instead */
+        return  display_setclonerect(ctx,rect);
+    }
+
+    if(g_secondary.released && (fb_id == 1))
+    {
+        return  0;
+    }
     
     sprintf(node, "/dev/graphics/fb%d", fb_id);
 
@@ -1759,10 +2019,7 @@ static int  display_setfbrect(struct display_context_t* ctx,int displayno,int fb
 		ioctl(ctx->mFD_fb[fb_id],FBIOGET_LAYER_HDL_0,&fb_layer_hdl);
 	}
 
-	scn_rect.x				= x;
-	scn_rect.y				= y;
-	scn_rect.width			= width;
-	scn_rect.height			= height;
+	scn_rect				= *rect;
 	
 	LOGD("scn_rect.width = %d,scn_rect.height = %d,screen = %d,fb_layer_hdl = %d,fb_id = %d\n",scn_rect.width,scn_rect.height,displayno,fb_layer_hdl,fb_id);
 	
@@ -1909,6 +2166,121 @@ static int  display_getminsize(struct display_context_t* ctx,int *min_width,int
     return  0;
 }
       
+/*
+**********************************************************************************************************************
+*                                               display_requestsecondary
+*
+* author:           
+*
+* date:             2026-10-17:10:40:0
+*
+* Description:      give the secondary screen of dual same mode its picture: a clone of the master fb (fb0) when the
+*                   layer scaler can take it, otherwise the scaled copy fb1 the master is blitted into
+*
+* parameters:       displayno: secondary screen, para: fb1 parameters, width/height are updated for the clone
+*
+* return:           if success return 0
+*                   if fail return the number of fail
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int  display_requestsecondary(struct display_context_t* ctx,int displayno,struct display_fbpara_t *para)
+{
+    g_secondary.para        = *para;
+    g_secondary.released    = false;
+
+    if(display_requestclone(ctx,displayno,0,para) == 0)
+    {
+        return  0;
+    }
+
+    return  display_requestfb(ctx,1,para);
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_releasesecondary
+*
+* author:           
+*
+* date:             2026-10-17:16:20:0
+*
+* Description:      give back the clone layer or fb1 of the secondary screen when dual same mode is left, nothing
+*                   is released twice when the hot plug gave it back already
+*
+* parameters:       
+*
+* return:           if success return 0
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int  display_releasesecondary(struct display_context_t* ctx)
+{
+    if(!g_secondary.released)
+    {
+        if(g_clone.hdl)
+        {
+            display_releaseclone(ctx);
+        }
+        else
+        {
+            display_releasefb(ctx,1);
+        }
+    }
+
+    g_secondary.released    = false;
+
+    return  0;
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_reclone
+*
+* author:           
+*
+* date:             2026-10-17:10:40:0
+*
+* Description:      the master fb was requested again, point the clone layer at its new memory and size
+*
+* parameters:       
+*
+* return:           if success return 0
+*                   if fail return the number of fail
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int  display_reclone(struct display_context_t* ctx)
+{
+    struct display_fbpara_t		para;
+    int                         displayno;
+    int                         ret;
+
+    displayno               = g_clone.screen;
+
+    display_releaseclone(ctx);
+
+    para.fb_mode            = (__fb_mode_t)g_display[displayno].fbmode;
+    para.format             = SECONDARY_PIXEL_FORMAT;
+    para.output_height      = g_display[displayno].height;
+    para.output_width       = g_display[displayno].width;
+    para.valid_height       = g_display[displayno].valid_height;
+    para.valid_width        = g_display[displayno].valid_width;
+    display_getminsize(ctx,&para.width,&para.height);
+    para.bufno              = 3;
+    para.layer_mode         = DISP_LAYER_WORK_MODE_SCALER;
+
+    ret = display_requestsecondary(ctx,displayno,&para);
+
+    g_display[displayno].fb_height      = para.height;
+    g_display[displayno].fb_width       = para.width;
+
+    return  ret;
+}
+
 /*
 **********************************************************************************************************************
 *                                               display_getmaxdisplayno
@@ -1950,6 +2322,33 @@ static int  display_getmaxdisplayno(struct display_device_t *dev)
     return num;
 }
 
+/*
+**********************************************************************************************************************
+*                                               display_getfbid
+*
+* author:           
+*
+* date:             2026-10-17:10:40:0
+*
+* Description:      the fb a screen shows: the master fb while the secondary screen clones it, fb1 is released then
+*
+* parameters:       
+*
+* return:           the fb id
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_getfbid(int displayno)
+{
+    if(g_clone.hdl && (g_clone.screen == displayno))
+    {
+        return  g_clone.srcfb;
+    }
+
+    return  g_display[displayno].fb_id;
+}
+
 static int display_getdisplaybufid(struct display_device_t *dev, int displayno)
 {
     struct display_context_t*   ctx = (struct display_context_t*)dev;
@@ -1960,7 +2359,7 @@ static int display_getdisplaybufid(struct display_device_t *dev, int displayno)
     
     //pthread_mutex_lock(&mode_lock);
     
-    fbid = g_display[displayno].fb_id;
+    fbid = display_getfbid(displayno);
 
     sprintf(node_src, "/dev/graphics/fb%d", fbid);
 
@@ -2040,6 +2439,180 @@ static int  display_output(struct display_context_t* ctx, int displayno, int out
     
     return   ret;
 }
+
+/*
+**********************************************************************************************************************
+*                                               display_readsecondarystatus
+*
+* author:           
+*
+* date:             2026-10-17:11:20:0
+*
+* Description:      hot plug state of the secondary screen of dual same mode, lcd and vga are always plugged in
+*
+* parameters:       
+*
+* return:           DISPLAY_PLUGIN or DISPLAY_PLUGOUT
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int  display_readsecondarystatus(struct display_context_t* ctx,int displayno)
+{
+    if(g_display[displayno].type == DISPLAY_DEVICE_HDMI)
+    {
+        return  display_readhdmistatus(ctx) ? DISPLAY_PLUGIN : DISPLAY_PLUGOUT;
+    }
+    else if(g_display[displayno].type == DISPLAY_DEVICE_TV)
+    {
+        return  display_gettvstatus((struct display_device_t *)ctx,displayno);
+    }
+
+    return  DISPLAY_PLUGIN;
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_suspendsecondary
+*
+* author:           
+*
+* date:             2026-10-17:14:10:0
+*
+* Description:      the secondary screen of dual same mode was unplugged, turn it off and give back fb1 (or the
+*                   clone layer) so its memory returns to the display reserve
+*
+* parameters:       
+*
+* return:           if success return 0
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int  display_suspendsecondary(struct display_context_t* ctx,int displayno)
+{
+    display_off(ctx,displayno,g_display[displayno].type);
+
+    display_releasesecondary(ctx);
+
+    g_secondary.released                = true;
+    g_display[displayno].isopen         = DISPLAY_FALSE;
+
+    LOGD("screen %d unplugged, secondary fb released\n",displayno);
+
+    return  0;
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_resumesecondary
+*
+* author:           
+*
+* date:             2026-10-17:14:10:0
+*
+* Description:      request the secondary screen again with the parameters it had before it was unplugged, the
+*                   caller found a sink plugged in
+*
+* parameters:       
+*
+* return:           if success return 0
+*                   if fail return the number of fail
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int  display_resumesecondary(struct display_context_t* ctx)
+{
+    struct display_fbpara_t		para;
+    int                         displayno;
+    int                         tvformat = 0;
+    int                         ret;
+
+    if(!g_secondary.released)
+    {
+        return  0;
+    }
+
+    displayno   = 1 - g_masterdisplay;
+    para        = g_secondary.para;
+
+    ret = display_requestsecondary(ctx,displayno,&para);
+    if(ret != 0)
+    {
+        LOGE("restore screen %d fail\n",displayno);
+
+        g_secondary.released            = true;
+
+        return  ret;
+    }
+
+    if(g_display[displayno].type != DISPLAY_DEVICE_LCD)
+    {
+        tvformat = get_tvformat(g_display[displayno].tvformat);
+    }
+
+    g_display[displayno].fb_height      = para.height;
+    g_display[displayno].fb_width       = para.width;
+    g_display[displayno].isopen         = DISPLAY_TRUE;
+
+    display_output(ctx,displayno,g_display[displayno].type,tvformat);
+
+    LOGD("screen %d plugged, secondary fb restored\n",displayno);
+
+    return  0;
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_checkhotplug
+*
+* author:           
+*
+* date:             2026-10-17:14:10:0
+*
+* Description:      follow the hot plug state of the secondary screen of dual same mode: release fb1 while nothing
+*                   is plugged in, request it again once a sink is back. called by the mode changes with the mode
+*                   lock held, the status getters only read the state
+*
+* parameters:       
+*
+* return:           if success return 0
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int  display_checkhotplug(struct display_context_t* ctx)
+{
+    int                         displayno;
+    int                         plugged;
+
+    if((ctx == NULL) || (ctx->mFD_disp == 0))
+    {
+        return  0;
+    }
+
+    if(g_displaymode == DISPLAY_MODE_DUALSAME)
+    {
+        displayno = 1 - g_masterdisplay;
+        plugged   = display_readsecondarystatus(ctx,displayno);
+
+        if((plugged == DISPLAY_PLUGOUT) && !g_secondary.released)
+        {
+            display_suspendsecondary(ctx,displayno);
+            display_publishfbstate();
+        }
+        else if((plugged != DISPLAY_PLUGOUT) && g_secondary.released)
+        {
+            display_resumesecondary(ctx);
+            display_publishfbstate();
+        }
+
+        g_display[displayno].hotplug    = plugged;
+    }
+
+    return  0;
+}
       
 /*
 **********************************************************************************************************************
@@ -2272,6 +2845,8 @@ static int display_dualsamechangemode(struct display_device_t *dev,int displayno
     int							tvformat = 0;
     int                         minwidth;
     int                         minheight;
+    bool                        cloned;
+    __disp_rect_t               scn_rect;
 
     
     if(displayno == g_masterdisplay)
@@ -2292,6 +2867,9 @@ static int display_dualsamechangemode(struct display_device_t *dev,int displayno
         {
             display_off(ctx,displayno,g_display[displayno].type);
                 
+            /* the clone layer scans out the fb released below */
+            cloned = (g_clone.hdl != 0);
+            display_releaseclone(ctx);
         	display_releasefb(ctx,g_display[displayno].fb_id);
 
         	para.fb_mode        = (__fb_mode_t)g_display[displayno].fbmode;
@@ -2332,6 +2910,11 @@ static int display_dualsamechangemode(struct display_device_t *dev,int displayno
             g_display[displayno].hotplug        = display_gethotplug(dev,displayno);
 
             display_output(ctx,displayno,value0,tvformat);
+
+            if(cloned)
+            {
+                display_reclone(ctx);
+            }
             
             return  0;
         }
@@ -2397,7 +2980,15 @@ static int display_dualsamechangemode(struct display_device_t *dev,int displayno
                 para.valid_height		= para.output_height;
             }
             
-            display_setfbrect(ctx,g_display[displayno].fb_id,displayno,(para.output_width - para.valid_width)>>1,(para.output_height - para.valid_height)>>1,para.valid_width,para.valid_height);
+            display_getscnrect(displayno,para.output_width,para.output_height,para.valid_width,para.valid_height,&scn_rect);
+            if(g_clone.hdl)
+            {
+                display_setclonerect(ctx,&scn_rect);
+            }
+            else
+            {
+                display_setfbrect(ctx,displayno,g_display[displayno].fb_id,&scn_rect);
+            }
 #endif
             g_display[displayno].tvformat       = value1;
             g_display[displayno].width          = para.output_width;
@@ -2442,6 +3033,8 @@ static int display_changemode(struct display_device_t *dev,int displayno,int val
     int 						status = 0;
     struct display_fbpara_t		para;
     int							tvformat = 0;
+    struct display_savedconfig_t    saved;
+    unsigned int                seq = 0;
     
     if (ctx) 
     {
@@ -2468,6 +3061,9 @@ static int display_changemode(struct display_device_t *dev,int displayno,int val
          }
 
          pthread_mutex_lock(&mode_lock);
+
+         /* fb1 follows the hot plug state of the secondary screen before the mode paths use it */
+         display_checkhotplug(ctx);
          
          if(g_display[displayno].type == DISPLAY_DEVICE_NONE || value0 == DISPLAY_DEVICE_NONE)
          {
@@ -2498,7 +3094,14 @@ static int display_changemode(struct display_device_t *dev,int displayno,int val
             status = -1;
          }
 
-         pthread_mutex_unlock(&mode_lock);
+         if(status == 0)
+         {
+            seq = display_snapconfig(&saved);
+         }
+
+         pthread_mutex_unlock(&mode_lock);
+
+         display_saveconfig(&saved,seq);
     } 
     else 
     {
@@ -2508,6 +3111,56 @@ static int display_changemode(struct display_device_t *dev,int displayno,int val
     return status;
 }
       
+/*
+**********************************************************************************************************************
+*                                               display_stageoutput
+*
+* author:           
+*
+* date:             2026-10-17:16:30:0
+*
+* Description:      record type, format and pixel format of an output in g_display[] without touching the hardware,
+*                   the sizes follow from the format, tvformat keeps the DISPLAY_TVFORMAT_* value
+*
+* parameters:       type: DISPLAY_DEVICE_*, format: DISPLAY_TVFORMAT_* / DISPLAY_VGA_*, ignored for lcd
+*
+* return:           if success return 0
+*                   if the format is invalid return -1, g_display[] is unchanged
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int  display_stageoutput(struct display_context_t* ctx,int displayno,int type,int format,int pixelformat)
+{
+    if(type != DISPLAY_DEVICE_LCD)
+    {
+        if(get_tvformat(format) == -1)
+        {
+            LOGE("Invalid TV Format!\n");
+
+            return  -1;
+        }
+
+        g_display[displayno].height  		= display_getheight(ctx,displayno,format);
+        g_display[displayno].width   		= display_getwidth(ctx,displayno,format);
+        g_display[displayno].valid_height  	= display_getvalidheight(ctx,displayno,format);
+        g_display[displayno].valid_width   	= display_getvalidwidth(ctx,displayno,format);
+    }
+    else
+    {
+        g_display[displayno].height  		= display_getheight(ctx,displayno,DISPLAY_DEFAULT);
+        g_display[displayno].width   		= display_getwidth(ctx,displayno,DISPLAY_DEFAULT);
+        g_display[displayno].valid_height  	= g_display[displayno].height;
+        g_display[displayno].valid_width   	= g_display[displayno].width;
+    }
+
+    g_display[displayno].type       = type;
+    g_display[displayno].tvformat   = format;
+    g_display[displayno].format     = pixelformat;
+
+    return  0;
+}
+      
 /*
 **********************************************************************************************************************
 *                                               display_setparameter
@@ -2529,7 +3182,6 @@ static int display_changemode(struct display_device_t *dev,int displayno,int val
 static int display_setparameter(struct display_device_t *dev, int displayno, int value0,int value1)
 {
     struct 	display_context_t* ctx = (struct display_context_t*)dev;
-    int							tvformat = 0;
     
     if(value0 <= DISPLAY_DEVICE_VGA)
     {
@@ -2540,27 +3192,9 @@ static int display_setparameter(struct display_device_t *dev, int displayno, int
             return -1;
         }
 
-        if(value0 != DISPLAY_DEVICE_LCD)
-        {
-            tvformat = get_tvformat(value1);
-    		if(tvformat == -1)
-    		{
-    			LOGE("Invalid TV Format!\n");
-
-    			return  -1;
-    		}
-
-            g_display[displayno].height  		= display_getheight(ctx,displayno,tvformat);
-            g_display[displayno].width   		= display_getwidth(ctx,displayno,tvformat);
-            g_display[displayno].valid_height  	= display_getvalidheight(ctx,displayno,tvformat);
-            g_display[displayno].valid_width   	= display_getvalidwidth(ctx,displayno,tvformat);
-        }
-        else
+        if(display_stageoutput(ctx,displayno,value0,value1,g_display[displayno].format) != 0)
         {
-            g_display[displayno].height  		= display_getheight(ctx,displayno,DISPLAY_DEFAULT);
-            g_display[displayno].width   		= display_getwidth(ctx,displayno,DISPLAY_DEFAULT);
-            g_display[displayno].valid_height  	= g_display[displayno].height;
-            g_display[displayno].valid_width   	= g_display[displayno].width;
+            return  -1;
         }
 
         if(displayno == 0)
@@ -2571,9 +3205,6 @@ static int display_setparameter(struct display_device_t *dev, int displayno, int
         {
             g_display[displayno].fbmode = FB_MODE_SCREEN1;
         }
-
-        g_display[displayno].type    = value0;
-        g_display[displayno].tvformat= tvformat;
     }
     else if(value0 == DISPLAY_PIXELMODE)
     {
@@ -2698,10 +3329,10 @@ static int display_releasemode(struct display_device_t *dev,int mode)
         display_off(ctx,0,outputtype0);
 
         display_off(ctx,1,outputtype1);
+
+        display_releasesecondary(ctx);
             
 		display_releasefb(ctx,0);
-
-        display_releasefb(ctx,1);
     }
 
     return    0;
@@ -2757,6 +3388,9 @@ static int display_requestsingle(struct display_device_t *dev)
     para.width          = g_display[g_masterdisplay].width;
     para.valid_height   = g_display[g_masterdisplay].valid_height;
     para.valid_width    = g_display[g_masterdisplay].valid_width;
+    para.output_height  = para.height;
+    para.output_width   = para.width;
+    para.bufno          = 2;
     para.layer_mode     = DISP_LAYER_WORK_MODE_NORMAL;
     display_requestfb(ctx,g_display[g_masterdisplay].fb_id,&para);
 
@@ -2937,11 +3571,15 @@ static int display_requestdualsame(struct display_device_t *dev)
     struct  display_fbpara_t	para;
     int							tvformat = 0;
     int                         i;
+    int                         n;
     int                         min_width;
     int                         min_height;
 
-    for(i = 0;i < MAX_DISPLAY_NUM;i++)
+    for(n = 0;n < MAX_DISPLAY_NUM;n++)
     {
+        /* master first, the secondary screen may scan out its fb */
+        i = (n == 0) ? g_masterdisplay : (1 - g_masterdisplay);
+
         if(g_display[i].type == DISPLAY_DEVICE_LCD)
         {
             if(i == 0)
@@ -2958,16 +3596,16 @@ static int display_requestdualsame(struct display_device_t *dev)
     		para.height     			= display_getheight(ctx,i,DISPLAY_DEFAULT);
             para.width      			= display_getwidth(ctx,i,DISPLAY_DEFAULT);
             para.valid_height      		= para.height;
-	        para.valid_width       		= para.valid_width;
+	        para.valid_width       		= para.width;
 	        para.output_height      	= para.height;
-	        para.output_width       	= para.valid_width;
+	        para.output_width       	= para.width;
             if(i == g_masterdisplay)
             {
                 display_requestfb(ctx,0,&para);
             }
             else
             {
-                display_requestfb(ctx,1,&para);
+                display_requestsecondary(ctx,i,&para);
             }
             g_display[i].isopen         = DISPLAY_TRUE;
             g_display[i].fb_height      = para.height;
@@ -3003,11 +3641,12 @@ static int display_requestdualsame(struct display_device_t *dev)
             {
                 display_getminsize(ctx,&min_width,&min_height);
                 
+                para.format         = SECONDARY_PIXEL_FORMAT;
                 para.width          = min_width;
                 para.height         = min_height;
                 para.layer_mode     = DISP_LAYER_WORK_MODE_SCALER;
 
-                display_requestfb(ctx,1,&para);
+                display_requestsecondary(ctx,i,&para);
             }
             
             g_display[i].isopen         = DISPLAY_TRUE;
@@ -3133,7 +3772,7 @@ static int display_singleswitchtosame(struct display_device_t *dev,int mode,bool
 	        }
 	        
 	        para.fb_mode            = (__fb_mode_t)g_display[1 - g_masterdisplay].fbmode;
-	        para.format             = HAL_PIXEL_FORMAT_BGRA_8888;
+	        para.format             = SECONDARY_PIXEL_FORMAT;
 	        para.output_height      = g_display[1 - g_masterdisplay].height;
 	        para.output_width       = g_display[1 - g_masterdisplay].width;
 	        para.valid_height      	= g_display[1 - g_masterdisplay].valid_height;
@@ -3144,7 +3783,7 @@ static int display_singleswitchtosame(struct display_device_t *dev,int mode,bool
             para.height         	= min_height;
             para.layer_mode     	= DISP_LAYER_WORK_MODE_SCALER;
 
-            display_requestfb(ctx,1,&para);
+            display_requestsecondary(ctx,1 - g_masterdisplay,&para);
 	        
 	        g_display[1 - g_masterdisplay].isopen         = DISPLAY_TRUE;
 	        g_display[1 - g_masterdisplay].fb_height      = para.height;
@@ -3174,7 +3813,7 @@ static int display_singleswitchtosame(struct display_device_t *dev,int mode,bool
 	        }
 	        
 	        para.fb_mode            = (__fb_mode_t)g_display[1 - g_masterdisplay].fbmode;
-	        para.format             = HAL_PIXEL_FORMAT_BGRA_8888;
+	        para.format             = SECONDARY_PIXEL_FORMAT;
 	        para.output_height      = g_display[1 - g_masterdisplay].height;
 	        para.output_width       = g_display[1 - g_masterdisplay].width;
 	        para.valid_height      	= g_display[1 - g_masterdisplay].valid_height;
@@ -3195,7 +3834,7 @@ static int display_singleswitchtosame(struct display_device_t *dev,int mode,bool
 			LOGD("para.width = %d\n",para.width);
 			LOGD("para.height = %d\n",para.height);
 			LOGD("tvformat = %d\n",tvformat);
-            display_requestfb(ctx,1,&para);
+            display_requestsecondary(ctx,1 - g_masterdisplay,&para);
 	        g_display[1 - g_masterdisplay].fb_id	      = 1;
 	        g_display[1 - g_masterdisplay].isopen         = DISPLAY_TRUE;
 	        g_display[1 - g_masterdisplay].fb_height      = para.height;
@@ -3241,7 +3880,7 @@ static int display_sameswitchtosingle(struct display_device_t *dev,int mode,bool
             
         display_off(ctx,1 - g_masterdisplay,outputtype);
 
-        display_releasefb(ctx,1);
+        display_releasesecondary(ctx);
 	    
 	    return  1;
     }
@@ -3262,6 +3901,52 @@ static int display_sameswitchtosingle(struct display_device_t *dev,int mode,bool
     return  0;	
 }
       
+/*
+**********************************************************************************************************************
+*                                               display_switchmode
+*
+* author:           
+*
+* date:             2026-10-17:16:30:0
+*
+* Description:      move the hardware from the current mode to mode for the outputs staged in g_display[], the
+*                   caller holds the mode lock
+*
+* parameters:       
+*
+* return:           if success return 0, the switches between single and dual same return 1
+*                   if fail return the number of fail
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_switchmode(struct display_device_t *dev,int mode)
+{
+    int                         ret;
+
+	if((g_displaymode == DISPLAY_MODE_SINGLE) && (mode == DISPLAY_MODE_DUALSAME))
+	{
+        g_displaymode = mode;
+		ret = display_singleswitchtosame(dev,mode,false);
+	}
+	else if((mode == DISPLAY_MODE_SINGLE) && (g_displaymode == DISPLAY_MODE_DUALSAME))
+	{	
+        g_displaymode = mode;
+		ret = display_sameswitchtosingle(dev,mode,false);
+	}
+	else
+	{
+        /* release what the current mode holds, then request for the new one */
+        display_releasemode(dev,g_displaymode);
+
+        g_displaymode = mode;
+
+        ret = display_requestmode(dev,mode);
+	}
+
+    return  ret;
+}
+      
 /*
 **********************************************************************************************************************
 *                                               display_setmode
@@ -3283,11 +3968,13 @@ static int display_sameswitchtosingle(struct display_device_t *dev,int mode,bool
 static int display_setmode(struct display_device_t *dev,int mode,struct display_modepara_t *para)
 {
     struct 	display_context_t*  ctx = (struct display_context_t*)dev;
-    int							tvformat = 0;
-    bool						masterchange;
     int							ret = 0;
+    struct display_savedconfig_t    saved;
+    unsigned int                seq = 0;
 
     pthread_mutex_lock(&mode_lock);
+
+    display_checkhotplug(ctx);
     
     if(g_displaymode != mode)
     {
@@ -3302,103 +3989,32 @@ static int display_setmode(struct display_device_t *dev,int mode,struct display_
 
         LOGD("para->d0format = %d,para->d0type = %d\n",para->d0format,para->d0type);
 
-        if(para->d0type != DISPLAY_DEVICE_LCD)
+        if(((para->d0type != DISPLAY_DEVICE_LCD) && (get_tvformat(para->d0format) == -1))
+           || ((para->d1type != DISPLAY_DEVICE_LCD) && (get_tvformat(para->d1format) == -1)))
         {
-            tvformat = get_tvformat(para->d0format);
-    		if(tvformat == -1)
-    		{
-    			LOGE("Invalid TV Format!\n");
+            LOGE("Invalid TV Format!\n");
 
-				pthread_mutex_unlock(&mode_lock);
-				
-    			return  -1;
-    		}
+            pthread_mutex_unlock(&mode_lock);
 
-            g_display[0].height  		= display_getheight(ctx,0,tvformat);
-            g_display[0].width   		= display_getwidth(ctx,0,tvformat);
-            g_display[0].valid_height  	= display_getvalidheight(ctx,0,tvformat);
-            g_display[0].valid_width   	= display_getvalidwidth(ctx,0,tvformat);
-        }
-        else
-        {
-            g_display[0].height  		= display_getheight(ctx,0,DISPLAY_DEFAULT);
-            g_display[0].width   		= display_getwidth(ctx,0,DISPLAY_DEFAULT);
-            g_display[0].valid_height 	= g_display[0].height;
-            g_display[0].valid_width 	= g_display[0].width;
+            return  -1;
         }
 
-        g_display[0].fbmode = FB_MODE_SCREEN0;
-        g_display[0].type    = para->d0type;
-        g_display[0].tvformat= para->d0format;
-   		g_display[0].format  = para->d0pixelformat;
-   		
-   		if(para->d1type != DISPLAY_DEVICE_LCD)
-        {
-            tvformat = get_tvformat(para->d1format);
-    		if(tvformat == -1)
-    		{
-    			LOGE("Invalid TV Format!\n");
-
-				pthread_mutex_unlock(&mode_lock);
-				
-    			return  -1;
-    		}
+        display_stageoutput(ctx,0,para->d0type,para->d0format,para->d0pixelformat);
+        display_stageoutput(ctx,1,para->d1type,para->d1format,para->d1pixelformat);
+        g_display[0].fbmode 	= FB_MODE_SCREEN0;
+        g_display[1].fbmode 	= FB_MODE_SCREEN0;
 
-            g_display[1].height  		= display_getheight(ctx,1,tvformat);
-            g_display[1].width   		= display_getwidth(ctx,1,tvformat);
-            g_display[1].valid_height  	= display_getvalidheight(ctx,1,tvformat);
-            g_display[1].valid_width   	= display_getvalidwidth(ctx,1,tvformat);
-        }
-        else
+        ret = display_switchmode(dev,mode);
+        if(ret >= 0)
         {
-            g_display[1].height  		= display_getheight(ctx,1,DISPLAY_DEFAULT);
-            g_display[1].width   		= display_getwidth(ctx,1,DISPLAY_DEFAULT);
-            g_display[1].valid_height 	= g_display[1].height;
-            g_display[1].valid_width 	= g_display[1].width;
+            /* the switches between single and dual same return 1 on success */
+            seq = display_snapconfig(&saved);
         }
-
-        g_display[1].fbmode 	= FB_MODE_SCREEN0;
-        g_display[1].type    	= para->d1type;
-        g_display[1].tvformat	= para->d1format;
-   		g_display[1].format  	= para->d1pixelformat;
-    	if(para->masterdisplay == g_masterdisplay)
-    	{
-    		masterchange = false;
-    	}
-    	else
-    	{
-    		masterchange = true;
-    	}
-    	
-    	//LOGD("g_displaymode1 = %d,mode = %d\n",g_displaymode,mode);
-    	
-    	if((g_displaymode == DISPLAY_MODE_SINGLE) && (mode == DISPLAY_MODE_DUALSAME))
-    	{
-            g_displaymode = mode;
-    		ret = display_singleswitchtosame(dev,mode,false);
-    	}
-    	else if((mode == DISPLAY_MODE_SINGLE) && (g_displaymode == DISPLAY_MODE_DUALSAME))
-    	{	
-            g_displaymode = mode;
-    		ret = display_sameswitchtosingle(dev,mode,false);
-    	}
-    	else
-    	{
-            g_displaymode = mode;
-	    	//LOGD("display_releasemode1!\n");
-	        /*ΪͷԭģʽԴ*/
-	        display_releasemode(dev,mode);
-	        
-	        //LOGD("display_releasemode2!\n");
-	
-	        /*ΪõģʽԴ*/
-	        display_requestmode(dev,mode);
-	        
-	        //LOGD("display_requestmode!\n");
-    	}
         
         pthread_mutex_unlock(&mode_lock);
 
+        display_saveconfig(&saved,seq);
+
         return  ret;
     }
     pthread_mutex_unlock(&mode_lock);
@@ -3598,8 +4214,8 @@ static int display_dualsamesetmaster(struct display_device_t *dev,int master)
         
         display_off(ctx,g_masterdisplay,g_display[g_masterdisplay].type);
         display_off(ctx,master,g_display[master].type);
+        display_releasesecondary(ctx);
         display_releasefb(ctx,0);
-        display_releasefb(ctx,1);
 
         if(master == 0)
         {
@@ -3657,7 +4273,7 @@ static int display_dualsamesetmaster(struct display_device_t *dev,int master)
             g_display[g_masterdisplay].fbmode       = FB_MODE_SCREEN1;
         }
 
-        para.format                                 = g_display[g_masterdisplay].format;
+        para.format                                 = SECONDARY_PIXEL_FORMAT;
         para.layer_mode                             = DISP_LAYER_WORK_MODE_SCALER;
         g_display[g_masterdisplay].fb_id            = 1;
         g_display[g_masterdisplay].layermode        = DISP_LAYER_WORK_MODE_SCALER;
@@ -3673,7 +4289,7 @@ static int display_dualsamesetmaster(struct display_device_t *dev,int master)
             para.valid_height		= para.output_height;
             para.valid_width		= para.output_width;
             
-            display_requestfb(ctx,g_display[g_masterdisplay].fb_id,&para);
+            display_requestsecondary(ctx,g_masterdisplay,&para);
         }
         else
         {
@@ -3690,7 +4306,7 @@ static int display_dualsamesetmaster(struct display_device_t *dev,int master)
             para.valid_height       = display_getvalidheight(ctx,g_masterdisplay,value1);
             para.valid_width        = display_getvalidwidth(ctx,g_masterdisplay,value1);
             
-            display_requestfb(ctx,g_display[g_masterdisplay].fb_id,&para);
+            display_requestsecondary(ctx,g_masterdisplay,&para);
         }
 
         display_gethotplug(dev,g_masterdisplay);
@@ -3724,9 +4340,14 @@ static int display_dualsamesetmaster(struct display_device_t *dev,int master)
 
 static int display_setmasterdisplay(struct display_device_t *dev,int master)
 {
-    int     ret;
+    struct display_savedconfig_t    saved;
+    unsigned int                    seq = 0;
+    int                             ret;
 
     pthread_mutex_lock(&mode_lock);
+
+    display_checkhotplug((struct display_context_t*)dev);
+
     if(g_displaymode == DISPLAY_MODE_SINGLE)
     {  
         ret = display_singlesetmaster(dev,master);
@@ -3744,254 +4365,1635 @@ static int display_setmasterdisplay(struct display_device_t *dev,int master)
         ret = display_duallcdsetmaster(dev,master);
     }
 
+    if(ret == 0)
+    {
+        seq = display_snapconfig(&saved);
+    }
+
     pthread_mutex_unlock(&mode_lock);
 
+    display_saveconfig(&saved,seq);
+
     return  ret;
 }
       
 /*
 **********************************************************************************************************************
-*                                               display_getmasterdisplay
+*                                               display_fillconfig
 *
 * author:           
 *
-* date:             2011-7-17:11:21:51
+* date:             2026-10-17:17:40:0
 *
-* Description:      display getmasterdisplay 
+* Description:      describe g_display[] as a configuration, the caller holds the mode lock
 *
 * parameters:       
 *
-* return:           if success return GUI_RET_OK
-*                   if fail return the number of fail
+* return:           
 * modify history: 
 **********************************************************************************************************************
 */
 
-static int display_getmasterdisplay(struct display_device_t *dev)
+static void display_fillconfig(struct display_config_t *config)
 {
-    return  g_masterdisplay;
+    int     i;
+
+    memset(config,0,sizeof(*config));
+    config->mode            = g_displaymode;
+    config->masterdisplay   = g_masterdisplay;
+    for(i = 0;i < MAX_DISPLAY_NUM;i++)
+    {
+        config->output[i].type          = g_display[i].type;
+        config->output[i].format        = g_display[i].tvformat;
+        config->output[i].pixelformat   = g_display[i].format;
+    }
 }
-      
+
 /*
 **********************************************************************************************************************
-*                                               display_getdisplaymode
+*                                               display_configchecksum
 *
 * author:           
 *
-* date:             2011-7-17:11:25:59
+* date:             2026-10-17:17:40:0
 *
-* Description:      display getdisplaymode 
+* Description:      fnv-1a over the saved configuration up to its checksum
 *
 * parameters:       
 *
-* return:           if success return GUI_RET_OK
-*                   if fail return the number of fail
+* return:           the checksum
 * modify history: 
 **********************************************************************************************************************
 */
 
-static int display_getdisplaymode(struct display_device_t *dev)
-{   
-    return  g_displaymode;
+static uint32_t display_configchecksum(const struct display_savedconfig_t *saved)
+{
+    const unsigned char     *p = (const unsigned char *)saved;
+    size_t                  len = offsetof(struct display_savedconfig_t,checksum);
+    uint32_t                hash = 2166136261u;
+
+    while(len--)
+    {
+        hash ^= *p++;
+        hash *= 16777619u;
+    }
+
+    return  hash;
 }
-      
+
 /*
 **********************************************************************************************************************
-*                                               display_opendev
+*                                               display_publishfbstate
 *
 * author:           
 *
-* date:             2011-7-17:11:26:1
+* date:             2026-10-17:16:50:0
 *
-* Description:      display opendev 
+* Description:      tell the other processes which fbs and clone layer back the screens, fb1 may be a clone layer,
+*                   a fb of minimum size or released by the hot plug, none of it follows from the configuration.
+*                   the caller holds the mode lock
 *
 * parameters:       
 *
-* return:           if success return GUI_RET_OK
-*                   if fail return the number of fail
+* return:           
 * modify history: 
 **********************************************************************************************************************
 */
 
-static int display_opendev(struct display_device_t *dev,int displayno)
+static void display_publishfbstate(void)
 {
-    struct display_context_t* ctx = (struct display_context_t*)dev;
-    int                       ret;
-
-    pthread_mutex_lock(&mode_lock);
-    ret = display_on(ctx,displayno,g_display[displayno].type);
-    if(ret == 0)
-    {
-        g_display[displayno].isopen = DISPLAY_TRUE;
-    }
+    char                        value[PROPERTY_VALUE_MAX];
 
-    pthread_mutex_unlock(&mode_lock);
+    snprintf(value,sizeof(value),"%d %d %d %d %d %d %d %d %d %d %d %lu %d %d %d %d",
+             (int)g_display[0].fb_id,(int)g_display[0].fb_width,(int)g_display[0].fb_height,
+             (int)g_display[0].fbmode,(int)g_display[0].isopen,
+             (int)g_display[1].fb_id,(int)g_display[1].fb_width,(int)g_display[1].fb_height,
+             (int)g_display[1].fbmode,(int)g_display[1].isopen,
+             g_secondary.released ? 1 : 0,
+             g_clone.hdl,g_clone.screen,g_clone.srcfb,g_clone.xres,g_clone.yres);
 
-    return ret;
+    property_set(DISPLAY_FBSTATE_PROPERTY,value);
 }
 
-static int display_globalinit(struct display_device_t *dev)
-{
-	//g_display[0].type  	= display_getoutputtype(dev,0);
-	//g_display[1].type  	= display_getoutputtype(dev,1);
-	//g_display[0].format = display_gettvformat(dev,0);
-	//g_display[1].format = display_gettvformat(dev,1);
-	//g_display[1].fb_id  =
-	g_display[0].type  			= DISPLAY_DEVICE_LCD;
-	g_display[0].format 		= HAL_PIXEL_FORMAT_BGRA_8888;
-	g_display[0].width 			= 800;
-	g_display[0].height 		= 480;  
-	g_display[0].fbmode			= FB_MODE_SCREEN0;
-	g_display[0].layermode		= DISP_LAYER_WORK_MODE_NORMAL;
-	g_display[0].fb_width 		= 800; 
-	g_display[0].fb_height 		= 480; 
-	
-	return  0;
-}
-      
 /*
 **********************************************************************************************************************
-*                                               display_closedev
+*                                               display_adoptfbstate
 *
 * author:           
 *
-* date:             2011-7-17:11:26:3
+* date:             2026-10-17:16:50:0
 *
-* Description:      display closedev 
+* Description:      take over the fbs and clone layer display_publishfbstate described, the layer handles of the
+*                   display driver are not bound to the process that requested them. the caller holds the mode lock
 *
 * parameters:       
 *
-* return:           if success return GUI_RET_OK
-*                   if fail return the number of fail
+* return:           if success return 0
+*                   if nothing was published return -1
 * modify history: 
 **********************************************************************************************************************
 */
 
-static int display_closedev(struct display_device_t *dev,int displayno)
+static int display_adoptfbstate(void)
 {
-    struct display_context_t* ctx = (struct display_context_t*)dev;
-    int                       ret;
+    char                        value[PROPERTY_VALUE_MAX];
+    int                         fb_id[MAX_DISPLAY_NUM];
+    int                         fb_width[MAX_DISPLAY_NUM];
+    int                         fb_height[MAX_DISPLAY_NUM];
+    int                         fbmode[MAX_DISPLAY_NUM];
+    int                         isopen[MAX_DISPLAY_NUM];
+    int                         released;
+    struct display_clone_t      clone;
+    int                         i;
 
-    pthread_mutex_lock(&mode_lock);
-    
-    ret = display_off(ctx,displayno,g_display[displayno].type);
-    if(ret == 0)
+    property_get(DISPLAY_FBSTATE_PROPERTY,value,"");
+    if(sscanf(value,"%d %d %d %d %d %d %d %d %d %d %d %lu %d %d %d %d",
+              &fb_id[0],&fb_width[0],&fb_height[0],&fbmode[0],&isopen[0],
+              &fb_id[1],&fb_width[1],&fb_height[1],&fbmode[1],&isopen[1],
+              &released,&clone.hdl,&clone.screen,&clone.srcfb,&clone.xres,&clone.yres) != 16)
     {
-        g_display[displayno].isopen = DISPLAY_FALSE;
+        return  -1;
     }
 
-    pthread_mutex_unlock(&mode_lock);
+    for(i = 0;i < MAX_DISPLAY_NUM;i++)
+    {
+        g_display[i].fb_id          = fb_id[i];
+        g_display[i].fb_width       = fb_width[i];
+        g_display[i].fb_height      = fb_height[i];
+        g_display[i].fbmode         = fbmode[i];
+        g_display[i].isopen         = isopen[i];
+    }
 
-    return ret;    
-}
+    g_secondary.released    = (released != 0);
+    g_clone                 = clone;
 
-static int display_getdisplaycount(struct display_device_t *dev)
-{
-	return MAX_DISPLAY_NUM;
+    return  0;
 }
-      
+
 /*
 **********************************************************************************************************************
-*                                               close_display
+*                                               display_snapconfig
 *
 * author:           
 *
-* date:             2011-7-17:11:26:14
+* date:             2026-10-17:11:50:0
 *
-* Description:      close display 
+* Description:      take the record of the configuration in effect after a successful mode change, the caller holds
+*                   the mode lock and hands it to display_saveconfig once it dropped the lock
 *
 * parameters:       
 *
-* return:           if success return GUI_RET_OK
-*                   if fail return the number of fail
+* return:           the sequence number of the record, later records supersede it
 * modify history: 
 **********************************************************************************************************************
 */
 
-static int close_display(struct hw_device_t *dev) 
+static unsigned int display_snapconfig(struct display_savedconfig_t *saved)
 {
-    int    i;
-    
-    struct display_context_t* ctx = (struct display_context_t*)dev;
-    if (ctx) 
-    {
-        if(ctx->mFD_disp)
-        {
-            close(ctx->mFD_disp);
-        }
+    memset(saved,0,sizeof(*saved));
+    saved->magic    = DISPLAY_CONFIG_MAGIC;
+    saved->version  = DISPLAY_CONFIG_VERSION;
+    saved->size     = sizeof(*saved);
+    display_fillconfig(&saved->config);
+    saved->checksum = display_configchecksum(saved);
 
-        if(ctx->mFD_mp)
-        {
-            close(ctx->mFD_mp);
-        }
+    display_publishfbstate();
 
-        for(i = 0;i < MAX_DISPLAY_NUM;i++)
-        {
-            if(ctx->mFD_fb[i])
-            {
-                close(ctx->mFD_fb[i]);
-            }
-        }
-        
-        free(ctx);
+    if(++g_saveseq == 0)
+    {
+        g_saveseq = 1;
     }
-    return 0;
+
+    return  g_saveseq;
 }
-      
+
 /*
 **********************************************************************************************************************
-*                                               open_display
+*                                               display_saveconfig
 *
 * author:           
 *
-* date:             2011-7-17:11:26:27
+* date:             2026-10-17:17:40:0
 *
-* Description:      open display 
+* Description:      save a record of display_snapconfig, written to a temporary file and renamed over the old one
+*                   so a power cut leaves either of them whole. called without the mode lock, the fsync does not
+*                   hold up the mode changes of other threads, a record older than the one on disk is dropped
 *
-* parameters:       
+* parameters:       seq: from display_snapconfig, 0 saves nothing
 *
-* return:           if success return GUI_RET_OK
-*                   if fail return the number of fail
+* return:           if success return 0
+*                   if fail return -1, the previous file is kept
 * modify history: 
 **********************************************************************************************************************
 */
 
-static int open_display(const struct hw_module_t* module, const char* name,
-        struct hw_device_t** device)
+static int display_saveconfig(const struct display_savedconfig_t *saved,unsigned int seq)
 {
-    int status = 0;
-    display_context_t *ctx;
-    ctx = (display_context_t *)malloc(sizeof(display_context_t));
-    memset(ctx, 0, sizeof(*ctx));
-
-    ctx->device.common.tag          = HARDWARE_DEVICE_TAG;
-    ctx->device.common.version      = 1;
-    ctx->device.common.module       = const_cast<hw_module_t*>(module);
-    ctx->device.common.close        = close_display;
-    ctx->device.changemode          = display_changemode;
-    ctx->device.setdisplaymode      = display_setmode;
-    ctx->device.setdisplayparameter = display_setparameter;
-    ctx->device.gethdmistatus       = display_gethdmistatus;
-    ctx->device.gettvdacstatus      = display_gettvdacstatus;
-    ctx->device.opendisplay         = display_opendev;
-    ctx->device.closedisplay        = display_closedev;
-    ctx->device.getdisplayparameter = display_getparameter;
-    ctx->device.copysrcfbtodstfb    = display_copyfb;
-    ctx->device.pandisplay          = display_pandisplay;
-    ctx->device.request_modelock    = display_requestmodelock;
-    ctx->device.release_modelock    = display_releasemodelock;
-    ctx->device.setmasterdisplay    = display_setmasterdisplay;
-    ctx->device.getmasterdisplay    = display_getmasterdisplay;
-    ctx->device.getdisplaybufid     = display_getdisplaybufid;
-    ctx->device.getmaxwidthdisplay  = display_getmaxdisplayno;
-    ctx->device.getdisplaycount  	= display_getdisplaycount;
-    ctx->device.getdisplaymode		= display_getdisplaymode;
-    ctx->device.gethdmimaxmode		= display_gethdmimaxmode;
+    static unsigned int             savedseq = 0;
+    int                             fd;
+    int                             ret;
 
-    //LOGD("start open_display!\n");
-    ctx->mFD_disp = open("/dev/disp", O_RDWR, 0);
-    LOGD("start open_display!ctx->mFD_disp = %x\n",ctx->mFD_disp);
-    if (ctx->mFD_disp < 0) 
+    if(seq == 0)
+    {
+        return  0;
+    }
+
+    pthread_mutex_lock(&save_lock);
+
+    if((int)(seq - savedseq) <= 0)
+    {
+        pthread_mutex_unlock(&save_lock);
+
+        return  0;
+    }
+
+    fd = open(DISPLAY_CONFIG_FILE ".tmp",O_WRONLY | O_CREAT | O_TRUNC,0600);
+    if(fd < 0)
+    {
+        LOGD("can not save display config, errno = %d\n",errno);
+
+        pthread_mutex_unlock(&save_lock);
+
+        return  -1;
+    }
+
+    ret = write(fd,saved,sizeof(*saved));
+    fsync(fd);
+    close(fd);
+
+    if((ret != (int)sizeof(*saved)) || (rename(DISPLAY_CONFIG_FILE ".tmp",DISPLAY_CONFIG_FILE) != 0))
+    {
+        LOGE("save display config fail, errno = %d\n",errno);
+
+        unlink(DISPLAY_CONFIG_FILE ".tmp");
+
+        pthread_mutex_unlock(&save_lock);
+
+        return  -1;
+    }
+
+    savedseq = seq;
+    property_set(DISPLAY_RESTORED_PROPERTY,DISPLAY_RESTORED_APPLIED);
+
+    pthread_mutex_unlock(&save_lock);
+
+    return  0;
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_loadconfig
+*
+* author:           
+*
+* date:             2026-10-17:17:40:0
+*
+* Description:      read the saved configuration
+*
+* parameters:       
+*
+* return:           if success return 0
+*                   if there is none or it is damaged return -1
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_loadconfig(struct display_config_t *config)
+{
+    struct display_savedconfig_t    saved;
+    int                             fd;
+    int                             ret;
+
+    fd = open(DISPLAY_CONFIG_FILE,O_RDONLY,0);
+    if(fd < 0)
+    {
+        return  -1;
+    }
+
+    ret = read(fd,&saved,sizeof(saved));
+    close(fd);
+
+    if((ret != (int)sizeof(saved)) || (saved.magic != DISPLAY_CONFIG_MAGIC)
+       || (saved.version != DISPLAY_CONFIG_VERSION) || (saved.size != sizeof(saved))
+       || (saved.checksum != display_configchecksum(&saved)))
+    {
+        LOGE("saved display config is damaged, ignored\n");
+
+        return  -1;
+    }
+
+    *config = saved.config;
+
+    return  0;
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_isplugged
+*
+* author:           
+*
+* date:             2026-10-17:17:40:0
+*
+* Description:      whether a sink is connected to an output type, lcd and vga are always taken as connected
+*
+* parameters:       
+*
+* return:           
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static bool display_isplugged(struct display_context_t* ctx,int type)
+{
+    if(type == DISPLAY_DEVICE_HDMI)
+    {
+        return  display_readhdmistatus(ctx) != 0;
+    }
+    else if(type == DISPLAY_DEVICE_TV)
+    {
+        return  display_readtvdacstatus(ctx) != DISPLAY_TVDAC_NONE;
+    }
+
+    return  true;
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_getconfig
+*
+* author:           
+*
+* date:             2026-10-17:16:30:0
+*
+* Description:      read the configuration in effect, the starting point of a transaction
+*
+* parameters:       
+*
+* return:           if success return 0
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_getconfig(struct display_device_t *dev,struct display_config_t *config)
+{
+    if(config == NULL)
+    {
+        return  -EINVAL;
+    }
+
+    pthread_mutex_lock(&mode_lock);
+
+    display_fillconfig(config);
+
+    pthread_mutex_unlock(&mode_lock);
+
+    return  0;
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_checkoutput
+*
+* author:           
+*
+* date:             2026-10-17:16:30:0
+*
+* Description:      check that an output can drive a format, an hdmi sink that is plugged in is asked for it
+*
+* parameters:       
+*
+* return:           if supported return 0
+*                   if not return -EINVAL
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_checkoutput(struct display_context_t* ctx,int type,int format)
+{
+    const struct display_modedesc_t *desc;
+    int                             output;
+
+    if(type == DISPLAY_DEVICE_LCD)
+    {
+        return  0;
+    }
+
+    if(type == DISPLAY_DEVICE_TV)
+    {
+        output = DISPLAY_MODE_OUTPUT_TV;
+    }
+    else if(type == DISPLAY_DEVICE_HDMI)
+    {
+        output = DISPLAY_MODE_OUTPUT_HDMI;
+    }
+    else if(type == DISPLAY_DEVICE_VGA)
+    {
+        output = DISPLAY_MODE_OUTPUT_VGA;
+    }
+    else
+    {
+        return  -EINVAL;
+    }
+
+    desc = display_findmode(format);
+    if((desc == NULL) || (desc->driver == -1) || !(desc->info.outputs & output))
+    {
+        return  -EINVAL;
+    }
+
+    if((type == DISPLAY_DEVICE_HDMI) && display_readhdmistatus(ctx) && !display_hdmisupportmode(ctx,format))
+    {
+        return  -EINVAL;
+    }
+
+    return  0;
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_validateconfig
+*
+* author:           
+*
+* date:             2026-10-17:16:30:0
+*
+* Description:      check a configuration without applying it, single mode only needs the master output
+*
+* parameters:       
+*
+* return:           if it can be committed return 0
+*                   if not return -EINVAL
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_validateconfig(struct display_device_t *dev,const struct display_config_t *config)
+{
+    struct 	display_context_t*  ctx = (struct display_context_t*)dev;
+    int                         i;
+
+    if((ctx == NULL) || (config == NULL))
+    {
+        return  -EINVAL;
+    }
+
+    if((config->mode < DISPLAY_MODE_SINGLE) || (config->mode > DISPLAY_MODE_DUALSAME)
+       || (config->masterdisplay < 0) || (config->masterdisplay >= MAX_DISPLAY_NUM))
+    {
+        LOGE("invalid mode %d or master %d\n",config->mode,config->masterdisplay);
+
+        return  -EINVAL;
+    }
+
+    for(i = 0;i < MAX_DISPLAY_NUM;i++)
+    {
+        if((config->mode == DISPLAY_MODE_SINGLE) && (i != config->masterdisplay))
+        {
+            continue;
+        }
+
+        if(display_checkoutput(ctx,config->output[i].type,config->output[i].format) != 0)
+        {
+            LOGE("screen %d can not drive type %d format %d\n",i,config->output[i].type,config->output[i].format);
+
+            return  -EINVAL;
+        }
+    }
+
+    return  0;
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_commitconfig
+*
+* author:           
+*
+* date:             2026-10-17:16:30:0
+*
+* Description:      apply a whole configuration in one pass under the mode lock: when only the outputs of the
+*                   current mode change each of them is changed alone, when only the master changes it is moved,
+*                   a new mode on the same master output goes through display_switchmode as setmode does, so
+*                   turning the mirror on or off leaves fb0 alone. anything else releases the current mode and
+*                   requests the new one once
+*
+* parameters:       
+*
+* return:           if success return 0
+*                   if nothing changed return 1
+*                   if fail return a negative value, an invalid configuration leaves everything as it was
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_commitconfig(struct display_device_t *dev,const struct display_config_t *config)
+{
+    struct 	display_context_t*  ctx = (struct display_context_t*)dev;
+    bool                        changed[MAX_DISPLAY_NUM];
+    bool                        pixelchanged = false;
+    int                         nchanged = 0;
+    int                         ret = 1;
+    int                         status;
+    int                         i;
+    struct display_savedconfig_t    saved;
+    unsigned int                seq = 0;
+
+    if(display_validateconfig(dev,config) != 0)
+    {
+        return  -EINVAL;
+    }
+
+    pthread_mutex_lock(&mode_lock);
+
+    display_checkhotplug(ctx);
+
+    for(i = 0;i < MAX_DISPLAY_NUM;i++)
+    {
+        changed[i]  = ((int)g_display[i].type != config->output[i].type)
+                      || ((config->output[i].type != DISPLAY_DEVICE_LCD) && ((int)g_display[i].tvformat != config->output[i].format));
+        if((int)g_display[i].format != config->output[i].pixelformat)
+        {
+            pixelchanged = true;
+        }
+        if(changed[i])
+        {
+            nchanged++;
+        }
+    }
+
+    if((config->mode == g_displaymode) && (config->masterdisplay == g_masterdisplay) && !pixelchanged)
+    {
+        for(i = 0;i < MAX_DISPLAY_NUM;i++)
+        {
+            if(!changed[i])
+            {
+                continue;
+            }
+
+            if((g_displaymode == DISPLAY_MODE_SINGLE) && (i != g_masterdisplay))
+            {
+                /* not shown in single mode, used by the next switch */
+                display_stageoutput(ctx,i,config->output[i].type,config->output[i].format,config->output[i].pixelformat);
+                ret = 0;
+                continue;
+            }
+
+            if(g_displaymode == DISPLAY_MODE_SINGLE)
+            {
+                status = display_singlechangemode(dev,i,config->output[i].type,config->output[i].format);
+            }
+            else if(g_displaymode == DISPLAY_MODE_DUALLCD)
+            {
+                status = display_duallcdchangemode(dev,i,config->output[i].type,config->output[i].format);
+            }
+            else if(g_displaymode == DISPLAY_MODE_DUALDIFF)
+            {
+                status = display_dualdiffchangemode(dev,i,config->output[i].type,config->output[i].format);
+            }
+            else
+            {
+                status = display_dualsamechangemode(dev,i,config->output[i].type,config->output[i].format);
+            }
+
+            if(status < 0)
+            {
+                ret = status;
+                break;
+            }
+            ret = 0;
+        }
+    }
+    else if((config->mode == g_displaymode) && !pixelchanged && (nchanged == 0))
+    {
+        if(g_displaymode == DISPLAY_MODE_SINGLE)
+        {  
+            ret = display_singlesetmaster(dev,config->masterdisplay);
+        }
+        else if(g_displaymode == DISPLAY_MODE_DUALSAME)
+        {
+            ret = display_dualsamesetmaster(dev,config->masterdisplay);
+        }
+        else if(g_displaymode == DISPLAY_MODE_DUALDIFF)
+        {
+            ret = display_dualdiffsetmaster(dev,config->masterdisplay);
+        }
+        else
+        {
+            ret = display_duallcdsetmaster(dev,config->masterdisplay);
+        }
+    }
+    else if((config->masterdisplay == g_masterdisplay) && !changed[g_masterdisplay] && !pixelchanged)
+    {
+        /* the master keeps its fb, switch the way setmode does, single and dual same only touch the secondary */
+        for(i = 0;i < MAX_DISPLAY_NUM;i++)
+        {
+            display_stageoutput(ctx,i,config->output[i].type,config->output[i].format,config->output[i].pixelformat);
+            g_display[i].fbmode = FB_MODE_SCREEN0;
+        }
+
+        status  = display_switchmode(dev,config->mode);
+        ret     = (status < 0) ? status : 0;
+    }
+    else
+    {
+        display_releasemode(dev,g_displaymode);
+
+        for(i = 0;i < MAX_DISPLAY_NUM;i++)
+        {
+            display_stageoutput(ctx,i,config->output[i].type,config->output[i].format,config->output[i].pixelformat);
+            g_display[i].fbmode = FB_MODE_SCREEN0;
+        }
+
+        g_masterdisplay = config->masterdisplay;
+        g_displaymode   = config->mode;
+
+        ret = display_requestmode(dev,config->mode);
+    }
+
+    if(ret == 0)
+    {
+        seq = display_snapconfig(&saved);
+    }
+
+    pthread_mutex_unlock(&mode_lock);
+
+    display_saveconfig(&saved,seq);
+
+    return  ret;
+}
+      
+/*
+**********************************************************************************************************************
+*                                               display_adoptconfig
+*
+* author:           
+*
+* date:             2026-10-17:11:50:0
+*
+* Description:      take over the saved configuration another process of this boot applied already, with the fbs
+*                   and clone layer it set up for it. only the state of the hal is set, the hardware is not touched
+*
+* parameters:       
+*
+* return:           if success return 0
+*                   if there is no valid saved configuration return -1
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_adoptconfig(struct display_device_t *dev)
+{
+    struct 	display_context_t*  ctx = (struct display_context_t*)dev;
+    struct display_config_t     config;
+    int                         i;
+
+    if(display_loadconfig(&config) != 0)
+    {
+        return  -1;
+    }
+
+    pthread_mutex_lock(&mode_lock);
+
+    if(display_adoptfbstate() != 0)
+    {
+        pthread_mutex_unlock(&mode_lock);
+
+        LOGE("no fb state published with the saved config, keep the boot mode\n");
+
+        return  -1;
+    }
+
+    for(i = 0;i < MAX_DISPLAY_NUM;i++)
+    {
+        display_stageoutput(ctx,i,config.output[i].type,config.output[i].format,config.output[i].pixelformat);
+        g_display[i].hotplug        = display_gethotplug(dev,i);
+    }
+
+    g_masterdisplay = config.masterdisplay;
+    g_displaymode   = config.mode;
+
+    pthread_mutex_unlock(&mode_lock);
+
+    LOGD("adopted display mode %d, master %d\n",config.mode,config.masterdisplay);
+
+    return  0;
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_restoreconfig
+*
+* author:           
+*
+* date:             2026-10-17:17:40:0
+*
+* Description:      apply the saved configuration on the first open of a boot, so boot animation and framework
+*                   start in the final mode: a master that is unplugged now drops it, an unplugged second screen
+*                   falls back to single mode on the master. the later opens of the boot take the configuration
+*                   over from the file once the hardware runs it
+*
+* parameters:       
+*
+* return:           if success return 0
+*                   if nothing was restored return -1
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_restoreconfig(struct display_device_t *dev)
+{
+    struct 	display_context_t*  ctx = (struct display_context_t*)dev;
+    struct display_config_t     config;
+    char                        value[PROPERTY_VALUE_MAX];
+    int                         master;
+
+    /* one process per boot drives the hardware to it, the others found it set already */
+    property_get(DISPLAY_RESTORED_PROPERTY,value,"0");
+    if(strcmp(value,DISPLAY_RESTORED_APPLIED) == 0)
+    {
+        return  display_adoptconfig(dev);
+    }
+    else if(strcmp(value,DISPLAY_RESTORED_CLAIMED) == 0)
+    {
+        return  -1;
+    }
+    property_set(DISPLAY_RESTORED_PROPERTY,DISPLAY_RESTORED_CLAIMED);
+
+    if(display_loadconfig(&config) != 0)
+    {
+        return  -1;
+    }
+
+    master = config.masterdisplay;
+    if((master < 0) || (master >= MAX_DISPLAY_NUM) || !display_isplugged(ctx,config.output[master].type))
+    {
+        LOGD("saved master screen is not connected, keep the boot mode\n");
+
+        return  -1;
+    }
+
+    if((config.mode != DISPLAY_MODE_SINGLE) && !display_isplugged(ctx,config.output[1 - master].type))
+    {
+        config.mode = DISPLAY_MODE_SINGLE;
+    }
+
+    if(display_commitconfig(dev,&config) < 0)
+    {
+        return  -1;
+    }
+
+    LOGD("restored display mode %d, master %d\n",config.mode,config.masterdisplay);
+
+    return  0;
+}
+      
+/*
+**********************************************************************************************************************
+*                                               display_setoverscan
+*
+* author:           
+*
+* date:             2026-10-17:20:10:0
+*
+* Description:      cut a percentage off each edge of the picture of a screen for the overscan of the tv, applied
+*                   live through the screen window of the layer showing it, the framebuffer is not touched
+*
+* parameters:       left/top/right/bottom: 0 to DISPLAY_OVERSCAN_MAX, all -1 goes back to the safe area of the format
+*
+* return:           if success return 0
+*                   if a value is out of range return -EINVAL
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_setoverscan(struct display_device_t *dev,int displayno,int left,int top,int right,int bottom)
+{
+    struct display_context_t*   ctx = (struct display_context_t*)dev;
+    struct display_overscan_t   *overscan;
+    __disp_rect_t               scn_rect;
+    bool                        reset;
+
+    if((displayno < 0) || (displayno >= MAX_DISPLAY_NUM))
+    {
+        return  -EINVAL;
+    }
+
+    reset = (left == -1) && (top == -1) && (right == -1) && (bottom == -1);
+    if(!reset && ((left < 0) || (left > DISPLAY_OVERSCAN_MAX) || (top < 0) || (top > DISPLAY_OVERSCAN_MAX)
+                  || (right < 0) || (right > DISPLAY_OVERSCAN_MAX) || (bottom < 0) || (bottom > DISPLAY_OVERSCAN_MAX)))
+    {
+        LOGE("overscan %d %d %d %d out of range\n",left,top,right,bottom);
+
+        return  -EINVAL;
+    }
+
+    pthread_mutex_lock(&mode_lock);
+
+    overscan            = &g_overscan[displayno];
+    overscan->enabled   = !reset;
+    overscan->left      = reset ? 0 : left;
+    overscan->top       = reset ? 0 : top;
+    overscan->right     = reset ? 0 : right;
+    overscan->bottom    = reset ? 0 : bottom;
+
+    if(g_display[displayno].isopen && (g_display[displayno].type != DISPLAY_DEVICE_LCD))
+    {
+        display_getscnrect(displayno,g_display[displayno].width,g_display[displayno].height,
+                           g_display[displayno].valid_width,g_display[displayno].valid_height,&scn_rect);
+
+        if(g_clone.hdl && (g_clone.screen == displayno))
+        {
+            display_setclonerect(ctx,&scn_rect);
+        }
+        else
+        {
+            display_setfbrect(ctx,displayno,g_display[displayno].fb_id,&scn_rect);
+        }
+    }
+
+    pthread_mutex_unlock(&mode_lock);
+
+    return  0;
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_getoverscan
+*
+* author:           
+*
+* date:             2026-10-17:20:10:0
+*
+* Description:      read the overscan of a screen, all -1 when it shows the safe area of its format
+*
+* parameters:       
+*
+* return:           if success return 0
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_getoverscan(struct display_device_t *dev,int displayno,int *left,int *top,int *right,int *bottom)
+{
+    struct display_overscan_t   *overscan;
+
+    if((displayno < 0) || (displayno >= MAX_DISPLAY_NUM) || !left || !top || !right || !bottom)
+    {
+        return  -EINVAL;
+    }
+
+    pthread_mutex_lock(&mode_lock);
+
+    overscan    = &g_overscan[displayno];
+    *left       = overscan->enabled ? overscan->left : -1;
+    *top        = overscan->enabled ? overscan->top : -1;
+    *right      = overscan->enabled ? overscan->right : -1;
+    *bottom     = overscan->enabled ? overscan->bottom : -1;
+
+    pthread_mutex_unlock(&mode_lock);
+
+    return  0;
+}
+      
+/*
+**********************************************************************************************************************
+*                                               display_getmodecount
+*
+* author:           
+*
+* date:             2026-10-17:19:00:0
+*
+* Description:      number of output formats in the mode table
+*
+* parameters:       
+*
+* return:           
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_getmodecount(struct display_device_t *dev)
+{
+    return  DISPLAY_MODE_NUM;
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_getmodeinfo
+*
+* author:           
+*
+* date:             2026-10-17:19:00:0
+*
+* Description:      describe entry index of the mode table, for hdmi only the modes the sink plugged in takes are
+*                   flagged DISPLAY_MODE_OUTPUT_HDMI
+*
+* parameters:       
+*
+* return:           if success return 0
+*                   if index is out of range return -EINVAL
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_getmodeinfo(struct display_device_t *dev,int index,struct display_modeinfo_t *info)
+{
+    struct display_context_t*   ctx = (struct display_context_t*)dev;
+
+    if((index < 0) || (index >= DISPLAY_MODE_NUM) || (info == NULL))
+    {
+        return  -EINVAL;
+    }
+
+    *info = g_modes[index].info;
+    if(info->outputs & DISPLAY_MODE_OUTPUT_HDMI)
+    {
+        display_readhdmistatus(ctx);
+    }
+    if((info->outputs & DISPLAY_MODE_OUTPUT_HDMI) && !display_hdmisupportmode(ctx,info->id))
+    {
+        info->outputs &= ~DISPLAY_MODE_OUTPUT_HDMI;
+    }
+
+    return  0;
+}
+      
+/*
+**********************************************************************************************************************
+*                                               display_getmasterdisplay
+*
+* author:           
+*
+* date:             2011-7-17:11:21:51
+*
+* Description:      display getmasterdisplay 
+*
+* parameters:       
+*
+* return:           if success return GUI_RET_OK
+*                   if fail return the number of fail
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_getmasterdisplay(struct display_device_t *dev)
+{
+    return  g_masterdisplay;
+}
+      
+/*
+**********************************************************************************************************************
+*                                               display_getdisplaymode
+*
+* author:           
+*
+* date:             2011-7-17:11:25:59
+*
+* Description:      display getdisplaymode 
+*
+* parameters:       
+*
+* return:           if success return GUI_RET_OK
+*                   if fail return the number of fail
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_getdisplaymode(struct display_device_t *dev)
+{   
+    return  g_displaymode;
+}
+      
+/*
+**********************************************************************************************************************
+*                                               display_opendev
+*
+* author:           
+*
+* date:             2011-7-17:11:26:1
+*
+* Description:      display opendev 
+*
+* parameters:       
+*
+* return:           if success return GUI_RET_OK
+*                   if fail return the number of fail
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_opendev(struct display_device_t *dev,int displayno)
+{
+    struct display_context_t* ctx = (struct display_context_t*)dev;
+    int                       ret;
+
+    pthread_mutex_lock(&mode_lock);
+    ret = display_on(ctx,displayno,g_display[displayno].type);
+    if(ret == 0)
+    {
+        g_display[displayno].isopen = DISPLAY_TRUE;
+    }
+
+    pthread_mutex_unlock(&mode_lock);
+
+    return ret;
+}
+
+static int display_globalinit(struct display_device_t *dev)
+{
+	//g_display[0].type  	= display_getoutputtype(dev,0);
+	//g_display[1].type  	= display_getoutputtype(dev,1);
+	//g_display[0].format = display_gettvformat(dev,0);
+	//g_display[1].format = display_gettvformat(dev,1);
+	//g_display[1].fb_id  =
+	g_display[0].type  			= DISPLAY_DEVICE_LCD;
+	g_display[0].format 		= HAL_PIXEL_FORMAT_BGRA_8888;
+	g_display[0].width 			= 800;
+	g_display[0].height 		= 480;  
+	g_display[0].fbmode			= FB_MODE_SCREEN0;
+	g_display[0].layermode		= DISP_LAYER_WORK_MODE_NORMAL;
+	g_display[0].fb_width 		= 800; 
+	g_display[0].fb_height 		= 480; 
+	
+	return  0;
+}
+      
+/*
+**********************************************************************************************************************
+*                                               display_closedev
+*
+* author:           
+*
+* date:             2011-7-17:11:26:3
+*
+* Description:      display closedev 
+*
+* parameters:       
+*
+* return:           if success return GUI_RET_OK
+*                   if fail return the number of fail
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_closedev(struct display_device_t *dev,int displayno)
+{
+    struct display_context_t* ctx = (struct display_context_t*)dev;
+    int                       ret;
+
+    pthread_mutex_lock(&mode_lock);
+    
+    ret = display_off(ctx,displayno,g_display[displayno].type);
+    if(ret == 0)
+    {
+        g_display[displayno].isopen = DISPLAY_FALSE;
+    }
+
+    pthread_mutex_unlock(&mode_lock);
+
+    return ret;    
+}
+
+static int display_getdisplaycount(struct display_device_t *dev)
+{
+	return MAX_DISPLAY_NUM;
+}
+      
+/*
+**********************************************************************************************************************
+*                                               display_async_run
+*
+* author:           
+*
+* date:             2026-10-17:15:20:0
+*
+* Description:      run one queued request through the synchronous path, which takes the mode lock itself
+*
+* parameters:       
+*
+* return:           the status of the synchronous call
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_async_run(struct display_context_t* ctx,struct display_async_req_t *req)
+{
+    struct display_device_t     *dev = &ctx->device.base;
+
+    if(req->kind == DISPLAY_ASYNC_SETMODE)
+    {
+        return  display_setmode(dev,req->value[0],&req->para);
+    }
+    else if(req->kind == DISPLAY_ASYNC_CHANGEMODE)
+    {
+        return  display_changemode(dev,req->value[0],req->value[1],req->value[2]);
+    }
+    else
+    {
+        return  display_setmasterdisplay(dev,req->value[0]);
+    }
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_async_complete
+*
+* author:           
+*
+* date:             2026-10-17:15:20:0
+*
+* Description:      report the status of a request to every caller merged into it
+*
+* parameters:       
+*
+* return:           
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static void display_async_complete(struct display_async_req_t *req,int status)
+{
+    int     i;
+
+    for(i = 0;i < req->nwaiters;i++)
+    {
+        if(req->waiters[i].callback)
+        {
+            req->waiters[i].callback(req->waiters[i].user,req->waiters[i].token,status);
+        }
+    }
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_freecontext
+*
+* author:           
+*
+* date:             2026-10-17:21:10:0
+*
+* Description:      close the drivers and free the device, the worker is stopped already
+*
+* parameters:       
+*
+* return:           
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static void display_freecontext(struct display_context_t* ctx)
+{
+    int    i;
+
+    if(ctx->mFD_disp)
+    {
+        close(ctx->mFD_disp);
+    }
+
+    if(ctx->mFD_mp)
+    {
+        close(ctx->mFD_mp);
+    }
+
+    for(i = 0;i < MAX_DISPLAY_NUM;i++)
+    {
+        if(ctx->mFD_fb[i])
+        {
+            close(ctx->mFD_fb[i]);
+        }
+    }
+    
+    pthread_cond_destroy(&ctx->async.cond);
+    pthread_mutex_destroy(&ctx->async.lock);
+    free(ctx);
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_async_thread
+*
+* author:           
+*
+* date:             2026-10-17:15:20:0
+*
+* Description:      worker thread of the asynchronous requests, callbacks are made without the queue lock held.
+*                   a callback closing the device cannot have the worker joined, it frees the device itself once
+*                   the callback returned and the queue is cancelled
+*
+* parameters:       
+*
+* return:           
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static void *display_async_thread(void *arg)
+{
+    struct display_context_t*   ctx = (struct display_context_t*)arg;
+    struct display_async_t      *async = &ctx->async;
+    struct display_async_req_t  req;
+    int                         status;
+    bool                        closing;
+
+    pthread_mutex_lock(&async->lock);
+    for(;;)
+    {
+        while((async->count == 0) && !async->quit)
+        {
+            pthread_cond_wait(&async->cond,&async->lock);
+        }
+
+        if(async->quit)
+        {
+            break;
+        }
+
+        /* copy out so callers can queue behind it while it runs */
+        req             = async->queue[async->head];
+        async->head     = (async->head + 1) % DISPLAY_ASYNC_QUEUE_LEN;
+        async->count--;
+        pthread_mutex_unlock(&async->lock);
+
+        status = display_async_run(ctx,&req);
+        display_async_complete(&req,status);
+
+        pthread_mutex_lock(&async->lock);
+    }
+
+    /* closing, whatever is left never runs */
+    while(async->count)
+    {
+        req             = async->queue[async->head];
+        async->head     = (async->head + 1) % DISPLAY_ASYNC_QUEUE_LEN;
+        async->count--;
+        pthread_mutex_unlock(&async->lock);
+
+        display_async_complete(&req,-ECANCELED);
+
+        pthread_mutex_lock(&async->lock);
+    }
+    closing         = async->closing;
+    pthread_mutex_unlock(&async->lock);
+
+    if(closing)
+    {
+        pthread_detach(pthread_self());
+        display_freecontext(ctx);
+    }
+
+    return  NULL;
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_async_queue
+*
+* author:           
+*
+* date:             2026-10-17:15:20:0
+*
+* Description:      queue a request for the worker, a request of the same kind (and screen for changemode) at the
+*                   tail of the queue has not started yet and is replaced by this one instead
+*
+* parameters:       req: kind and parameters of the request, waiters are not used
+*
+* return:           token of the request > 0
+*                   -EBUSY if the queue or the waiters of the merged request are full
+*                   -errno if the worker could not be started
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_async_queue(struct display_context_t* ctx,struct display_async_req_t *req,
+                               display_async_callback_t callback,void *user)
+{
+    struct display_async_t      *async = &ctx->async;
+    struct display_async_req_t  *tail = NULL;
+    struct display_async_waiter_t waiter;
+    int                         ret;
+
+    pthread_mutex_lock(&async->lock);
+
+    if(!async->started)
+    {
+        async->quit     = false;
+        ret = pthread_create(&async->thread,NULL,display_async_thread,ctx);
+        if(ret != 0)
+        {
+            LOGE("start display worker fail %d\n",ret);
+
+            pthread_mutex_unlock(&async->lock);
+
+            return  -ret;
+        }
+        async->started  = true;
+    }
+
+    if(async->count)
+    {
+        tail = &async->queue[(async->head + async->count - 1) % DISPLAY_ASYNC_QUEUE_LEN];
+        if((tail->kind != req->kind)
+           || ((req->kind == DISPLAY_ASYNC_CHANGEMODE) && (tail->value[0] != req->value[0])))
+        {
+            tail = NULL;
+        }
+    }
+
+    if(tail == NULL)
+    {
+        if(async->count == DISPLAY_ASYNC_QUEUE_LEN)
+        {
+            pthread_mutex_unlock(&async->lock);
+
+            return  -EBUSY;
+        }
+
+        tail            = &async->queue[(async->head + async->count) % DISPLAY_ASYNC_QUEUE_LEN];
+        tail->nwaiters  = 0;
+        async->count++;
+    }
+    else if(tail->nwaiters == DISPLAY_ASYNC_MAX_WAITERS)
+    {
+        pthread_mutex_unlock(&async->lock);
+
+        return  -EBUSY;
+    }
+
+    if(++async->next_token <= 0)
+    {
+        async->next_token = 1;
+    }
+
+    waiter.callback     = callback;
+    waiter.user         = user;
+    waiter.token        = async->next_token;
+
+    tail->kind          = req->kind;
+    tail->value[0]      = req->value[0];
+    tail->value[1]      = req->value[1];
+    tail->value[2]      = req->value[2];
+    tail->para          = req->para;
+    tail->waiters[tail->nwaiters++] = waiter;
+
+    pthread_cond_signal(&async->cond);
+    pthread_mutex_unlock(&async->lock);
+
+    return  waiter.token;
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_async_stop
+*
+* author:           
+*
+* date:             2026-10-17:15:20:0
+*
+* Description:      stop the worker, the request running finishes, the queued ones complete with -ECANCELED
+*
+* parameters:       
+*
+* return:           true if called from a callback on the worker, which then frees the device when it exits
+*                   false once the worker is gone
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static bool display_async_stop(struct display_context_t* ctx)
+{
+    struct display_async_t      *async = &ctx->async;
+    bool                        started;
+    bool                        self;
+
+    pthread_mutex_lock(&async->lock);
+    started         = async->started;
+    self            = started && pthread_equal(async->thread,pthread_self());
+    async->quit     = true;
+    async->closing  = self;
+    pthread_cond_signal(&async->cond);
+    pthread_mutex_unlock(&async->lock);
+
+    if(self)
+    {
+        return  true;
+    }
+
+    if(started)
+    {
+        pthread_join(async->thread,NULL);
+        async->started = false;
+    }
+
+    return  false;
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_setmode_async
+*
+* author:           
+*
+* date:             2026-10-17:15:20:0
+*
+* Description:      display_setmode on the worker thread
+*
+* parameters:       
+*
+* return:           token of the request, or a negative errno
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_setmode_async(struct display_device_t *dev,int mode,struct display_modepara_t *para,
+                                 display_async_callback_t callback,void *user)
+{
+    struct display_async_req_t  req;
+
+    if((dev == NULL) || (para == NULL))
+    {
+        return  -EINVAL;
+    }
+
+    req.kind        = DISPLAY_ASYNC_SETMODE;
+    req.value[0]    = mode;
+    req.value[1]    = 0;
+    req.value[2]    = 0;
+    req.para        = *para;
+
+    return  display_async_queue((struct display_context_t*)dev,&req,callback,user);
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_changemode_async
+*
+* author:           
+*
+* date:             2026-10-17:15:20:0
+*
+* Description:      display_changemode on the worker thread
+*
+* parameters:       
+*
+* return:           token of the request, or a negative errno
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_changemode_async(struct display_device_t *dev,int displayno,int value0,int value1,
+                                    display_async_callback_t callback,void *user)
+{
+    struct display_async_req_t  req;
+
+    if(dev == NULL)
+    {
+        return  -EINVAL;
+    }
+
+    memset(&req.para,0,sizeof(req.para));
+    req.kind        = DISPLAY_ASYNC_CHANGEMODE;
+    req.value[0]    = displayno;
+    req.value[1]    = value0;
+    req.value[2]    = value1;
+
+    return  display_async_queue((struct display_context_t*)dev,&req,callback,user);
+}
+
+/*
+**********************************************************************************************************************
+*                                               display_setmasterdisplay_async
+*
+* author:           
+*
+* date:             2026-10-17:15:20:0
+*
+* Description:      display_setmasterdisplay on the worker thread
+*
+* parameters:       
+*
+* return:           token of the request, or a negative errno
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int display_setmasterdisplay_async(struct display_device_t *dev,int master,
+                                          display_async_callback_t callback,void *user)
+{
+    struct display_async_req_t  req;
+
+    if(dev == NULL)
+    {
+        return  -EINVAL;
+    }
+
+    memset(&req.para,0,sizeof(req.para));
+    req.kind        = DISPLAY_ASYNC_SETMASTER;
+    req.value[0]    = master;
+    req.value[1]    = 0;
+    req.value[2]    = 0;
+
+    return  display_async_queue((struct display_context_t*)dev,&req,callback,user);
+}
+
+/*
+**********************************************************************************************************************
+*                                               close_display
+*
+* author:           
+*
+* date:             2011-7-17:11:26:14
+*
+* Description:      close display 
+*
+* parameters:       
+*
+* return:           if success return GUI_RET_OK
+*                   if fail return the number of fail
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int close_display(struct hw_device_t *dev) 
+{
+    struct display_context_t* ctx = (struct display_context_t*)dev;
+    if (ctx) 
+    {
+        /* from a completion callback the worker frees it once the callback returns */
+        if(!display_async_stop(ctx))
+        {
+            display_freecontext(ctx);
+        }
+    }
+    return 0;
+}
+      
+/*
+**********************************************************************************************************************
+*                                               open_display
+*
+* author:           
+*
+* date:             2011-7-17:11:26:27
+*
+* Description:      open display 
+*
+* parameters:       
+*
+* return:           if success return GUI_RET_OK
+*                   if fail return the number of fail
+* modify history: 
+**********************************************************************************************************************
+*/
+
+static int open_display(const struct hw_module_t* module, const char* name,
+        struct hw_device_t** device)
+{
+    int status = 0;
+    display_context_t *ctx;
+    ctx = (display_context_t *)malloc(sizeof(display_context_t));
+    memset(ctx, 0, sizeof(*ctx));
+    pthread_mutex_init(&ctx->async.lock, NULL);
+    pthread_cond_init(&ctx->async.cond, NULL);
+
+    ctx->device.base.common.tag          = HARDWARE_DEVICE_TAG;
+    ctx->device.base.common.version      = 1;
+    ctx->device.base.common.module       = const_cast<hw_module_t*>(module);
+    ctx->device.base.common.close        = close_display;
+    ctx->device.base.changemode          = display_changemode;
+    ctx->device.base.setdisplaymode      = display_setmode;
+    ctx->device.base.setdisplayparameter = display_setparameter;
+    ctx->device.base.gethdmistatus       = display_gethdmistatus;
+    ctx->device.base.gettvdacstatus      = display_gettvdacstatus;
+    ctx->device.base.opendisplay         = display_opendev;
+    ctx->device.base.closedisplay        = display_closedev;
+    ctx->device.base.getdisplayparameter = display_getparameter;
+    ctx->device.base.copysrcfbtodstfb    = display_copyfb;
+    ctx->device.base.pandisplay          = display_pandisplay;
+    ctx->device.base.request_modelock    = display_requestmodelock;
+    ctx->device.base.release_modelock    = display_releasemodelock;
+    ctx->device.base.setmasterdisplay    = display_setmasterdisplay;
+    ctx->device.base.getmasterdisplay    = display_getmasterdisplay;
+    ctx->device.base.getdisplaybufid     = display_getdisplaybufid;
+    ctx->device.base.getmaxwidthdisplay  = display_getmaxdisplayno;
+    ctx->device.base.getdisplaycount  	= display_getdisplaycount;
+    ctx->device.base.getdisplaymode		= display_getdisplaymode;
+    ctx->device.base.gethdmimaxmode		= display_gethdmimaxmode;
+    ctx->device.setdisplaymode_async    = display_setmode_async;
+    ctx->device.changemode_async        = display_changemode_async;
+    ctx->device.setmasterdisplay_async  = display_setmasterdisplay_async;
+    ctx->device.getconfig               = display_getconfig;
+    ctx->device.validateconfig          = display_validateconfig;
+    ctx->device.commitconfig            = display_commitconfig;
+    ctx->device.getmodecount            = display_getmodecount;
+    ctx->device.getmodeinfo             = display_getmodeinfo;
+    ctx->device.setoverscan             = display_setoverscan;
+    ctx->device.getoverscan             = display_getoverscan;
+
+    //LOGD("start open_display!\n");
+    ctx->mFD_disp = open("/dev/disp", O_RDWR, 0);
+    LOGD("start open_display!ctx->mFD_disp = %x\n",ctx->mFD_disp);
+    if (ctx->mFD_disp < 0) 
     {
         status = errno;
         LOGE("Error opening frame buffer errno=%d (%s)",
@@ -4001,20 +6003,24 @@ static int open_display(const struct hw_module_t* module, const char* name,
 
     if (status == 0) 
     {
-        *device = &ctx->device.common;
+        *device = &ctx->device.base.common;
     } 
     else 
     {
-        close_display(&ctx->device.common);
+        close_display(&ctx->device.base.common);
     }
 
     if(mutex_inited == false)
     {
         pthread_mutex_init(&mode_lock, NULL);
 
-		//display_globalinit(NULL);
-		
         mutex_inited = true;
+
+        if(status == 0)
+        {
+		    display_globalinit(&ctx->device.base);
+		    display_restoreconfig(&ctx->device.base);
+        }
     }
     
     return status;
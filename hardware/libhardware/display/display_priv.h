@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DISPLAY_PRIV_H_
+#define DISPLAY_PRIV_H_
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <hardware/display.h>
+
+__BEGIN_DECLS
+
+/*****************************************************************************/
+
+/* outputs able to drive a mode */
+#define DISPLAY_MODE_OUTPUT_TV      0x1
+#define DISPLAY_MODE_OUTPUT_HDMI    0x2
+#define DISPLAY_MODE_OUTPUT_VGA     0x4
+
+/*
+ * An output format: id is the DISPLAY_TVFORMAT_* / DISPLAY_VGA_* value,
+ * valid_width and valid_height the safe area the picture is scaled into.
+ */
+struct display_modeinfo_t {
+    int id;
+    int width;
+    int height;
+    int valid_width;
+    int valid_height;
+    int refresh;
+    int interlace;
+    int outputs;
+};
+
+/*
+ * A full configuration of both screens. format is a DISPLAY_TVFORMAT_* or
+ * DISPLAY_VGA_* value and is ignored for an lcd, pixelformat a
+ * HAL_PIXEL_FORMAT_*. In single mode only the master output is shown, the
+ * other one is kept for the next switch.
+ */
+struct display_config_t {
+    int mode;
+    int masterdisplay;
+    struct {
+        int type;
+        int format;
+        int pixelformat;
+    } output[2];
+};
+
+/*
+ * Completion of an asynchronous request. Called on the HAL worker thread with
+ * the token the request returned and the status the synchronous call would
+ * have returned, -ECANCELED if the device was closed before it ran.
+ */
+typedef void (*display_async_callback_t)(void *user, int token, int status);
+
+/*
+ * The device returned by the display module can be cast to this to reach the
+ * sun4i extensions. The asynchronous calls return a token > 0 at once, or a
+ * negative errno if the request could not be queued. A request queued right
+ * behind a pending one of the same kind replaces its parameters, every caller
+ * is then completed with the status of the merged request.
+ */
+struct private_display_device_t {
+    struct display_device_t base;
+
+    int (*setdisplaymode_async)(struct display_device_t *dev, int mode,
+            struct display_modepara_t *para,
+            display_async_callback_t callback, void *user);
+    int (*changemode_async)(struct display_device_t *dev, int displayno,
+            int value0, int value1,
+            display_async_callback_t callback, void *user);
+    int (*setmasterdisplay_async)(struct display_device_t *dev, int master,
+            display_async_callback_t callback, void *user);
+
+    /*
+     * Transactions: fill a configuration from the current one, change it and
+     * commit it. validateconfig checks the output types and formats, and with
+     * an hdmi sink plugged in that it supports the format. commitconfig
+     * validates again, then applies everything under the mode lock with the
+     * fewest mode changes: 0 when applied, 1 when nothing changed, a negative
+     * value on error.
+     */
+    int (*getconfig)(struct display_device_t *dev,
+            struct display_config_t *config);
+    int (*validateconfig)(struct display_device_t *dev,
+            const struct display_config_t *config);
+    int (*commitconfig)(struct display_device_t *dev,
+            const struct display_config_t *config);
+
+    /*
+     * The formats the HAL knows, index from 0 to getmodecount() - 1. The
+     * sizes come from a table, only the hdmi flag asks the sink, once per
+     * mode and plug.
+     */
+    int (*getmodecount)(struct display_device_t *dev);
+    int (*getmodeinfo)(struct display_device_t *dev, int index,
+            struct display_modeinfo_t *info);
+
+    /*
+     * Overscan of a tv screen, in percent of the output cut from each edge.
+     * It takes effect at once by moving the layer window, and follows the
+     * screen through mode changes. All -1 restores the safe area of the
+     * format.
+     */
+    int (*setoverscan)(struct display_device_t *dev, int displayno,
+            int left, int top, int right, int bottom);
+    int (*getoverscan)(struct display_device_t *dev, int displayno,
+            int *left, int *top, int *right, int *bottom);
+};
+
+/*****************************************************************************/
+
+__END_DECLS
+
+#endif /* DISPLAY_PRIV_H_ */
@@ -15,18 +15,24 @@
 
 LOCAL_PATH := $(call my-dir)
 
-ifeq ($(BOARD_USES_GPS_TYPE),simulator)
+ifneq ($(filter simulator uart,$(BOARD_USES_GPS_TYPE)),)
 # HAL module implemenation, not prelinked and stored in
 # hw/<GPS_HARDWARE_MODULE_ID>.<ro.hardware>.so
+# reads a serial receiver when GPS_DEVICE is set in gps.conf, the qemud
+# channel otherwise
 include $(CLEAR_VARS)
 LOCAL_PRELINK_MODULE := false
 LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
 LOCAL_CFLAGS += -DQEMU_HARDWARE
+# two sentence ids hashing to one nmea_dispatch slot must fail the build
+LOCAL_CFLAGS += -Werror=override-init
 LOCAL_SHARED_LIBRARIES := liblog libcutils libhardware
 LOCAL_SRC_FILES := gps.c
 LOCAL_MODULE := gps.sun4i
 LOCAL_MODULE_TAGS := debug
 include $(BUILD_SHARED_LIBRARY)
+
+include $(LOCAL_PATH)/tests/Android.mk
 endif
 
 ifeq ($(BOARD_USES_GPS_TYPE),haiweixun)
@@ -24,21 +24,33 @@
 
 
 #include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include <pthread.h>
 #include <fcntl.h>
 #include <sys/epoll.h>
 #include <math.h>
 #include <time.h>
+#include <stdio.h>
+#include <termios.h>
+#include <sys/uio.h>
 
 #define  LOG_TAG  "gps_qemu"
 #include <cutils/log.h>
 #include <cutils/sockets.h>
+#include <cutils/properties.h>
 #include <hardware/gps.h>
 #include <hardware/qemud.h>
 
+#include "gps_priv.h"
+
 /* the name of the qemud-controlled socket */
 #define  QEMU_CHANNEL_NAME  "gps"
 
+/* a receiver on a serial port, when one is configured */
+#define  GPS_CONF_FILE      "/system/etc/gps.conf"
+#define  GPS_DEFAULT_BAUD   9600
+
 #define  GPS_DEBUG  0
 
 #if GPS_DEBUG
@@ -60,54 +72,59 @@ typedef struct {
     const char*  end;
 } Token;
 
-#define  MAX_NMEA_TOKENS  16
+/* enough for a full GSV with a signal id, and most proprietary sentences */
+#define  MAX_NMEA_TOKENS  32
 
+/* field i runs from base+start[i] to the separator before base+start[i+1].
+ * empty fields are kept, so a field is always found at its position */
 typedef struct {
-    int     count;
-    Token   tokens[ MAX_NMEA_TOKENS ];
+    int             count;
+    const char*     base;
+    unsigned short  start[ MAX_NMEA_TOKENS + 1 ];
 } NmeaTokenizer;
 
+enum {
+    NMEA_CHAR_DATA  = 0,
+    NMEA_CHAR_COMMA = 1,
+    NMEA_CHAR_END   = 2,    /* checksum mark or line end */
+};
+
+static const unsigned char  nmea_char_class[256] = {
+    [',']  = NMEA_CHAR_COMMA,
+    ['*']  = NMEA_CHAR_END,
+    ['\r'] = NMEA_CHAR_END,
+    ['\n'] = NMEA_CHAR_END,
+};
+
 static int
 nmea_tokenizer_init( NmeaTokenizer*  t, const char*  p, const char*  end )
 {
-    int    count = 0;
-    char*  q;
+    int  count = 0;
+    int  len, i;
 
     // the initial '$' is optional
     if (p < end && p[0] == '$')
         p += 1;
 
-    // remove trailing newline
-    if (end > p && end[-1] == '\n') {
-        end -= 1;
-        if (end > p && end[-1] == '\r')
-            end -= 1;
-    }
-
-    // get rid of checksum at the end of the sentecne
-    if (end >= p+3 && end[-3] == '*') {
-        end -= 3;
-    }
-
-    while (p < end) {
-        const char*  q = p;
+    len = end - p;
+    if (len > 0xfffe)
+        len = 0xfffe;
 
-        q = memchr(p, ',', end-p);
-        if (q == NULL)
-            q = end;
+    t->base     = p;
+    t->start[0] = 0;
 
-        if (q > p) {
-            if (count < MAX_NMEA_TOKENS) {
-                t->tokens[count].p   = p;
-                t->tokens[count].end = q;
-                count += 1;
-            }
-        }
-        if (q < end)
-            q += 1;
+    // a single pass, each separator closes the field before it
+    for (i = 0; i < len; i++) {
+        int  c = nmea_char_class[(unsigned char)p[i]];
 
-        p = q;
+        if (c == NMEA_CHAR_DATA)
+            continue;
+        t->start[++count] = i + 1;
+        if (c == NMEA_CHAR_END || count == MAX_NMEA_TOKENS)
+            break;
     }
+    if (i == len && len > 0 && count < MAX_NMEA_TOKENS)
+        t->start[++count] = len + 1;
 
     t->count = count;
     return count;
@@ -121,8 +138,10 @@ nmea_tokenizer_get( NmeaTokenizer*  t, int  index )
 
     if (index < 0 || index >= t->count) {
         tok.p = tok.end = dummy;
-    } else
-        tok = t->tokens[index];
+    } else {
+        tok.p   = t->base + t->start[index];
+        tok.end = t->base + t->start[index + 1] - 1;
+    }
 
     return tok;
 }
@@ -145,6 +164,9 @@ str2int( const char*  p, const char*  end )
         if ((unsigned)c >= 10)
             goto Fail;
 
+        if (result > (INT_MAX - 9) / 10)
+            goto Fail;
+
         result = result*10 + c;
     }
     return  result;
@@ -153,12 +175,12 @@ Fail:
     return -1;
 }
 
+/* only for numbers too long for the exact path below, nmea never sends them */
 static double
-str2float( const char*  p, const char*  end )
+str2float_strtod( const char*  p, const char*  end )
 {
-    int   result = 0;
     int   len    = end - p;
-    char  temp[16];
+    char  temp[32];
 
     if (len >= (int)sizeof(temp))
         return 0.;
@@ -168,77 +190,447 @@ str2float( const char*  p, const char*  end )
     return strtod( temp, NULL );
 }
 
+/* a decimal number read from a token: value = mant / 10^scale */
+typedef struct {
+    uint64_t  mant;
+    int       scale;
+    int       neg;
+    int       exact;    /* mant < 2^53 and scale <= 18 */
+} NmeaNumber;
+
+static const double  pow10_float[19] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,
+    1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18
+};
+
+static const uint64_t  pow10_int[19] = {
+    1ULL,                 10ULL,                100ULL,
+    1000ULL,              10000ULL,             100000ULL,
+    1000000ULL,           10000000ULL,          100000000ULL,
+    1000000000ULL,        10000000000ULL,       100000000000ULL,
+    1000000000000ULL,     10000000000000ULL,    100000000000000ULL,
+    1000000000000000ULL,  10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL
+};
+
+/* reads [+-]digits[.digits] and stops at the first other character, like
+ * strtod does for the numbers nmea uses */
+static void
+nmea_number_parse( NmeaNumber*  n, const char*  p, const char*  end )
+{
+    int  point  = 0;
+    int  digits = 0;
+
+    n->mant  = 0;
+    n->scale = 0;
+    n->neg   = 0;
+    n->exact = 1;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        n->neg = (*p == '-');
+        p += 1;
+    }
+    for ( ; p < end; p++ ) {
+        unsigned  c = (unsigned)(*p - '0');
+
+        if (c < 10) {
+            if (n->mant >= (1ULL << 53) / 10) {
+                n->exact = 0;
+                return;
+            }
+            n->mant   = n->mant*10 + c;
+            n->scale += point;
+            digits   += 1;
+        } else if (*p == '.' && !point) {
+            point = 1;
+        } else {
+            break;
+        }
+    }
+    if (n->scale >= 19)
+        n->exact = 0;
+    // a lone sign is no number, strtod gives +0 for it
+    if (!digits)
+        n->neg = 0;
+}
+
+/* both operands are exact doubles, so this is the one correctly rounded
+ * division that strtod returns too */
+static double
+nmea_number_value( const NmeaNumber*  n )
+{
+    double  v = (double)n->mant / pow10_float[n->scale];
+    return n->neg ? -v : v;
+}
+
+static double
+str2float( const char*  p, const char*  end )
+{
+    NmeaNumber  n;
+
+    nmea_number_parse( &n, p, end );
+    if (!n.exact)
+        return str2float_strtod( p, end );
+
+    return nmea_number_value( &n );
+}
+
+static int
+hex2int( int  c )
+{
+    if ((unsigned)(c - '0') < 10)
+        return c - '0';
+    c |= 0x20;
+    if ((unsigned)(c - 'a') < 6)
+        return c - 'a' + 10;
+    return -1;
+}
+
+/* xor of all bytes in [p,end), four at a time then folded */
+static int
+nmea_checksum( const char*  p, const char*  end )
+{
+    uint32_t  acc = 0;
+    int       sum;
+
+    for ( ; end - p >= 4; p += 4 ) {
+        uint32_t  w;
+        memcpy( &w, p, 4 );
+        acc ^= w;
+    }
+    acc ^= acc >> 16;
+    acc ^= acc >> 8;
+    sum  = acc & 0xff;
+
+    for ( ; p < end; p++ )
+        sum ^= (unsigned char)*p;
+
+    return sum;
+}
+
+enum {
+    NMEA_SENTENCE_OK        = 0,
+    NMEA_SENTENCE_CORRUPT   = 1,    /* checksum mismatch */
+    NMEA_SENTENCE_MALFORMED = 2,    /* no '$', a cut '*hh' or bad hex */
+    NMEA_SENTENCE_UNCHECKED = 3     /* no '*' at all, the checksum is optional */
+};
+
+/* checks "$<body>*hh" or "$<body>" with an optional trailing \r\n */
+static int
+nmea_sentence_check( const char*  p, const char*  end )
+{
+    int  hi, lo;
+
+    if (end > p && end[-1] == '\n') {
+        end -= 1;
+        if (end > p && end[-1] == '\r')
+            end -= 1;
+    }
+    if (end - p < 4 || p[0] != '$')
+        return NMEA_SENTENCE_MALFORMED;
+    if (end[-3] != '*')
+        return memchr(p, '*', end - p) ? NMEA_SENTENCE_MALFORMED
+                                       : NMEA_SENTENCE_UNCHECKED;
+
+    hi = hex2int(end[-2]);
+    lo = hex2int(end[-1]);
+    if ((hi | lo) < 0)
+        return NMEA_SENTENCE_MALFORMED;
+
+    if (nmea_checksum(p + 1, end - 3) != (hi << 4 | lo))
+        return NMEA_SENTENCE_CORRUPT;
+
+    return NMEA_SENTENCE_OK;
+}
+
 /*****************************************************************/
 /*****************************************************************/
 /*****                                                       *****/
-/*****       N M E A   P A R S E R                           *****/
+/*****       L O C A T I O N   B A T C H                     *****/
 /*****                                                       *****/
 /*****************************************************************/
 /*****************************************************************/
 
-#define  NMEA_MAX_SIZE  83
+/* a location in a batch, as the difference from the one before it. the
+ * first one of a batch is against base_time and a zero position. the
+ * differences wrap, a longitude across the date line is still exact */
+typedef struct {
+    int32_t   dt;           /* ms */
+    int32_t   dlat;         /* 1e-7 degree */
+    int32_t   dlon;
+    int32_t   dalt;         /* cm */
+    uint16_t  speed;        /* cm/s */
+    uint16_t  bearing;      /* 0.01 degree */
+    uint16_t  accuracy;     /* 10cm */
+    uint16_t  flags;
+} GpsBatchEntry;
 
 typedef struct {
-    int     pos;
-    int     overflow;
-    int     utc_year;
-    int     utc_mon;
-    int     utc_day;
-    int     utc_diff;
-    GpsLocation  fix;
-    gps_location_callback  callback;
-    char    in[ NMEA_MAX_SIZE+1 ];
-} NmeaReader;
+    int         latency;    /* ms, 0 when fixes go to location_cb */
+    int         count;
+    long long   due;        /* monotonic us the batch goes out by, 0 if not set */
+    GpsUtcTime  base_time;
+    GpsUtcTime  last_time;
+    int32_t     last_lat;
+    int32_t     last_lon;
+    int32_t     last_alt;
+    unsigned    batches;
+    unsigned    locations;
+    gps_batch_callback  callback;
+    GpsBatchEntry  entries[ GPS_BATCH_MAX_LOCATIONS ];
+    GpsLocation    out[ GPS_BATCH_MAX_LOCATIONS ];
+} GpsBatch;
+
+
+static int32_t
+gps_batch_quant( double  v, double  scale )
+{
+    double  q = floor( v * scale + 0.5 );
+
+    if (!(q > INT32_MIN))
+        return INT32_MIN;
+    return q > INT32_MAX ? INT32_MAX : (int32_t) q;
+}
+
+
+static uint16_t
+gps_batch_quant16( double  v, double  scale )
+{
+    double  q = floor( v * scale + 0.5 );
+
+    if (q < 0)
+        return 0;
+    return q > 65535 ? 65535 : (uint16_t) q;
+}
+
+
+/* decodes the batch and hands it over in one call */
+static void
+gps_batch_flush( GpsBatch*  b )
+{
+    GpsUtcTime  t   = b->base_time;
+    int32_t     lat = 0, lon = 0, alt = 0;
+    int         i;
+
+    for (i = 0; i < b->count; i++) {
+        const GpsBatchEntry*  e   = &b->entries[i];
+        GpsLocation*          loc = &b->out[i];
+
+        t   += e->dt;
+        lat  = (uint32_t)lat + (uint32_t)e->dlat;
+        lon  = (uint32_t)lon + (uint32_t)e->dlon;
+        alt  = (uint32_t)alt + (uint32_t)e->dalt;
+
+        loc->size      = sizeof(*loc);
+        loc->flags     = e->flags;
+        loc->latitude  = lat * 1e-7;
+        loc->longitude = lon * 1e-7;
+        loc->altitude  = alt * 0.01;
+        loc->speed     = e->speed * 0.01f;
+        loc->bearing   = e->bearing * 0.01f;
+        loc->accuracy  = e->accuracy * 0.1f;
+        loc->timestamp = t;
+    }
+
+    if (b->count > 0 && b->callback) {
+        D("%s: %d locations", __FUNCTION__, b->count);
+        b->callback( b->out, b->count );
+        b->batches   += 1;
+        b->locations += b->count;
+    }
+    b->count = 0;
+    b->due   = 0;
+}
 
 
 static void
-nmea_reader_update_utc_diff( NmeaReader*  r )
+gps_batch_add( GpsBatch*  b, const GpsLocation*  loc )
 {
-    time_t         now = time(NULL);
-    struct tm      tm_local;
-    struct tm      tm_utc;
-    long           time_local, time_utc;
+    GpsBatchEntry*  e;
+    int32_t         lat = 0, lon = 0, alt = 0;
+    long long       dt  = loc->timestamp - b->last_time;
 
-    gmtime_r( &now, &tm_utc );
-    localtime_r( &now, &tm_local );
+    // a clock jump the entry cannot hold starts a new batch
+    if (b->count > 0 && dt != (int32_t)dt)
+        gps_batch_flush( b );
+
+    if (b->count == 0) {
+        b->base_time = b->last_time = loc->timestamp;
+        b->last_lat  = b->last_lon = b->last_alt = 0;
+    }
 
-    time_local = tm_local.tm_sec +
-                 60*(tm_local.tm_min +
-                 60*(tm_local.tm_hour +
-                 24*(tm_local.tm_yday +
-                 365*tm_local.tm_year)));
+    if (loc->flags & GPS_LOCATION_HAS_LAT_LONG) {
+        lat = gps_batch_quant( loc->latitude, 1e7 );
+        lon = gps_batch_quant( loc->longitude, 1e7 );
+    } else {
+        lat = b->last_lat;
+        lon = b->last_lon;
+    }
+    if (loc->flags & GPS_LOCATION_HAS_ALTITUDE)
+        alt = gps_batch_quant( loc->altitude, 100 );
+    else
+        alt = b->last_alt;
+
+    e = &b->entries[ b->count++ ];
+    e->dt       = loc->timestamp - b->last_time;
+    e->dlat     = (uint32_t)lat - (uint32_t)b->last_lat;
+    e->dlon     = (uint32_t)lon - (uint32_t)b->last_lon;
+    e->dalt     = (uint32_t)alt - (uint32_t)b->last_alt;
+    e->speed    = gps_batch_quant16( loc->speed, 100 );
+    e->bearing  = gps_batch_quant16( loc->bearing, 100 );
+    e->accuracy = gps_batch_quant16( loc->accuracy, 10 );
+    e->flags    = loc->flags;
+
+    b->last_time = loc->timestamp;
+    b->last_lat  = lat;
+    b->last_lon  = lon;
+    b->last_alt  = alt;
+
+    if (b->count == GPS_BATCH_MAX_LOCATIONS)
+        gps_batch_flush( b );
+}
 
-    time_utc = tm_utc.tm_sec +
-               60*(tm_utc.tm_min +
-               60*(tm_utc.tm_hour +
-               24*(tm_utc.tm_yday +
-               365*tm_utc.tm_year)));
 
-    r->utc_diff = time_utc - time_local;
+/* latency 0 sends what is kept and goes back to location_cb */
+static void
+gps_batch_set( GpsBatch*  b, int  latency, gps_batch_callback  callback )
+{
+    if (latency <= 0 || callback == NULL) {
+        gps_batch_flush( b );
+        b->latency = 0;
+        return;
+    }
+    b->latency  = latency;
+    b->callback = callback;
+    b->due      = 0;
 }
 
 
+/*****************************************************************/
+/*****************************************************************/
+/*****                                                       *****/
+/*****       N M E A   P A R S E R                           *****/
+/*****                                                       *****/
+/*****************************************************************/
+/*****************************************************************/
+
+#define  NMEA_MAX_SIZE  83
+
+/* reads go straight into in[], only the incomplete last sentence or ubx
+ * frame is kept between reads, so it always has room for a large read */
+#define  NMEA_BUFF_SIZE  2048
+
+/* ubx frame: b5 62, class, id, 16-bit length, payload, 2 checksum bytes */
+#define  UBX_SYNC1        0xb5
+#define  UBX_SYNC2        0x62
+#define  UBX_MAX_PAYLOAD  1016
+#define  UBX_CLASS_NAV    0x01
+#define  UBX_NAV_PVT      0x07
+#define  UBX_NAV_SAT      0x35
+#define  UBX_CLASS_CFG    0x06
+#define  UBX_CFG_RATE     0x08
+
+/* nmea sentences ignored while ubx fixes come in, before falling back */
+#define  UBX_IDLE_SENTENCES  64
+
+/* sentences merged into the fix of an epoch */
+#define  NMEA_FIX_GGA  0x01
+#define  NMEA_FIX_RMC  0x02
+#define  NMEA_FIX_VTG  0x04
+#define  NMEA_FIX_GSA  0x08
+#define  NMEA_FIX_GLL  0x10
+#define  NMEA_FIX_GNS  0x20
+
+/* sentences the parser knows, counted apart */
+enum {
+    NMEA_KIND_UNKNOWN = 0,
+    NMEA_KIND_GGA,
+    NMEA_KIND_RMC,
+    NMEA_KIND_GSA,
+    NMEA_KIND_GSV,
+    NMEA_KIND_VTG,
+    NMEA_KIND_GLL,
+    NMEA_KIND_ZDA,
+    NMEA_KIND_GNS,
+    NMEA_KIND_PROPRIETARY,
+    NMEA_KIND_COUNT
+};
+
+static const char* const  nmea_kind_names[ NMEA_KIND_COUNT ] = {
+    "unknown", "gga", "rmc", "gsa", "gsv", "vtg", "gll", "zda", "gns", "proprietary"
+};
+
+/* a fix still waiting for sentences is sent after this much silence */
+#define  NMEA_EPOCH_TIMEOUT_MS  150
+
+/* an epoch this close to the fix interval is taken as due */
+#define  NMEA_INTERVAL_SLACK_MS  20
+
+typedef struct {
+    int     pos;        /* bytes of the incomplete sentence at the start of in[] */
+    int     ubx_active;     /* the receiver sends ubx fixes, nmea is ignored */
+    int     nmea_idle;      /* nmea sentences since the last ubx fix */
+    long    utc_days;       /* days since 1970 of the current date, -1 if none */
+    long    utc_tod;        /* ms since midnight of the last time, -1 if none */
+    int     utc_zda;        /* the date comes from ZDA, RMC's is ignored */
+    unsigned  accepted;     /* sentences and ubx frames passed to the parser */
+    unsigned  rejected;     /* checksum mismatch */
+    unsigned  malformed;    /* too short, or a damaged checksum field */
+    unsigned  unchecked;    /* no checksum field, parsed all the same */
+    int     checksummed;    /* a sentence with a checksum was seen, those without are cut ones */
+    int     nochecksum;     /* configured for a receiver that leaves checksums out, take them anyway */
+    unsigned  epochs;
+    unsigned  sentences[ NMEA_KIND_COUNT ];
+    long long  scan_us;     /* time spent parsing */
+    char    epoch[12];      /* time field of the current epoch */
+    int     epoch_len;
+    int     fix_types;      /* NMEA_FIX_* seen this epoch */
+    int     epoch_types;    /* NMEA_FIX_* seen last epoch, the fix is complete with them */
+    int     fix_sent;       /* the fix of this epoch went out */
+    int     fix_interval;   /* ms between fixes sent, 0 for every epoch */
+    long    last_due;       /* time of the last epoch sent, -1 if none */
+    int     skipping;       /* this epoch is not due, its sentences are dropped */
+    long    ubx_itow;       /* time of week of the last NAV-PVT */
+    int     ubx_period;     /* ms between the last two NAV-PVT */
+    double  pdop;
+    double  hdop;
+    double  vdop;
+    GpsSvStatus  sv;        /* satellites seen in the current epoch */
+    int     sv_ready;       /* entries of sv from complete GSV groups */
+    int     sv_next;        /* next GSV sentence expected in the group, 0 if none */
+    int     sv_pending;     /* a GSV group was completed this epoch */
+    uint32_t  sv_used;      /* used in fix mask from this epoch's GSA */
+    GpsLocation  fix;
+    gps_location_callback  callback;
+    gps_sv_status_callback  sv_callback;
+    GpsBatch*  batch;       /* where fixes go while batching */
+    char    in[ NMEA_BUFF_SIZE ];
+} NmeaReader;
+
+
 static void
 nmea_reader_init( NmeaReader*  r )
 {
     memset( r, 0, sizeof(*r) );
 
     r->pos      = 0;
-    r->overflow = 0;
-    r->utc_year = -1;
-    r->utc_mon  = -1;
-    r->utc_day  = -1;
+    r->utc_days = -1;
+    r->utc_tod  = -1;
     r->callback = NULL;
     r->fix.size = sizeof(r->fix);
-
-    nmea_reader_update_utc_diff( r );
+    r->sv.size  = sizeof(r->sv);
+    r->last_due = -1;
+    r->ubx_itow = -1;
 }
 
 
 static void
-nmea_reader_set_callback( NmeaReader*  r, gps_location_callback  cb )
+nmea_reader_set_callback( NmeaReader*  r, const GpsCallbacks*  cbs )
 {
-    r->callback = cb;
+    gps_location_callback  cb = cbs ? cbs->location_cb : NULL;
+
+    r->callback    = cb;
+    r->sv_callback = cbs ? cbs->sv_status_cb : NULL;
     if (cb != NULL && r->fix.flags != 0) {
         D("%s: sending latest fix to new callback", __FUNCTION__);
         r->callback( &r->fix );
@@ -247,43 +639,74 @@ nmea_reader_set_callback( NmeaReader*  r, gps_location_callback  cb )
 }
 
 
-static int
-nmea_reader_update_time( NmeaReader*  r, Token  tok )
+/* days since 1970-01-01 of a date of the gregorian calendar, from
+ * howard hinnant's days_from_civil. no time zone, no table, no libc */
+static long
+days_from_civil( int  year, int  mon, int  day )
+{
+    long      era;
+    unsigned  yoe, doy, doe;
+
+    year -= (mon <= 2);
+    era   = (year >= 0 ? year : year - 399) / 400;
+    yoe   = (unsigned)(year - era * 400);
+    doy   = (153 * (mon > 2 ? mon - 3 : mon + 9) + 2) / 5 + day - 1;
+    doe   = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (long)doe - 719468;
+}
+
+
+/* hhmmss.sss to ms since midnight, -1 if malformed */
+static long
+nmea_time_of_day( Token  tok )
 {
-    int        hour, minute;
-    double     seconds;
-    struct tm  tm;
-    time_t     fix_time;
+    NmeaNumber  n;
+    int         hour, minute;
+    long        ms;
 
     if (tok.p + 6 > tok.end)
         return -1;
 
-    if (r->utc_year < 0) {
-        // no date yet, get current one
-        time_t  now = time(NULL);
-        gmtime_r( &now, &tm );
-        r->utc_year = tm.tm_year + 1900;
-        r->utc_mon  = tm.tm_mon + 1;
-        r->utc_day  = tm.tm_mday;
-    }
+    hour   = str2int(tok.p,   tok.p+2);
+    minute = str2int(tok.p+2, tok.p+4);
+    nmea_number_parse( &n, tok.p+4, tok.end );
+    if (hour < 0 || hour > 23 || minute < 0 || minute > 59 ||
+            !n.exact || n.neg || n.scale > 6)
+        return -1;
+
+    // 60 is a leap second
+    ms = (long)(n.mant * 1000 / pow10_int[n.scale]);
+    if (ms >= 61000)
+        return -1;
+
+    return (hour*60 + minute) * 60000L + ms;
+}
 
-    hour    = str2int(tok.p,   tok.p+2);
-    minute  = str2int(tok.p+2, tok.p+4);
-    seconds = str2float(tok.p+4, tok.end);
 
-    tm.tm_hour  = hour;
-    tm.tm_min   = minute;
-    tm.tm_sec   = (int) seconds;
-    tm.tm_year  = r->utc_year - 1900;
-    tm.tm_mon   = r->utc_mon - 1;
-    tm.tm_mday  = r->utc_day;
-    tm.tm_isdst = -1;
+static int
+nmea_reader_update_time( NmeaReader*  r, Token  tok )
+{
+    long  tod = nmea_time_of_day( tok );
+
+    if (tod < 0)
+        return -1;
+
+    if (r->utc_days < 0) {
+        // no date yet, take the day that puts the fix nearest to now
+        long long  now = (long long)time(NULL) * 1000;
+        r->utc_days = (long)((now - tod + 43200000) / 86400000);
+    } else if (r->utc_tod >= 0 && tod + 43200000 < r->utc_tod) {
+        // midnight passed before a sentence with the new date came in
+        r->utc_days += 1;
+    }
+    r->utc_tod = tod;
 
-    fix_time = mktime( &tm ) + r->utc_diff;
-    r->fix.timestamp = (long long)fix_time * 1000;
+    r->fix.timestamp = (long long)r->utc_days * 86400000 + tod;
     return 0;
 }
 
+
+/* ddmmyy of RMC, the century is assumed */
 static int
 nmea_reader_update_date( NmeaReader*  r, Token  date, Token  time )
 {
@@ -298,27 +721,43 @@ nmea_reader_update_date( NmeaReader*  r, Token  date, Token  time )
     mon  = str2int(tok.p+2, tok.p+4);
     year = str2int(tok.p+4, tok.p+6) + 2000;
 
-    if ((day|mon|year) < 0) {
+    if (day < 1 || day > 31 || mon < 1 || mon > 12 || year < 2000) {
         D("date not properly formatted: '%.*s'", tok.end-tok.p, tok.p);
         return -1;
     }
 
-    r->utc_year  = year;
-    r->utc_mon   = mon;
-    r->utc_day   = day;
+    if (!r->utc_zda) {
+        r->utc_days = days_from_civil( year, mon, day );
+        r->utc_tod  = -1;
+    }
 
     return nmea_reader_update_time( r, time );
 }
 
 
+/* (d)ddmm.mmmm to degrees. degrees and minutes are split in integers, so the
+ * minutes are rounded once instead of carrying the error of the whole value */
 static double
 convert_from_hhmm( Token  tok )
 {
-    double  val     = str2float(tok.p, tok.end);
-    int     degrees = (int)(floor(val) / 100);
-    double  minutes = val - degrees*100.;
-    double  dcoord  = degrees + minutes / 60.0;
-    return dcoord;
+    NmeaNumber  n;
+    uint64_t    unit;
+    int         degrees;
+    double      minutes;
+
+    nmea_number_parse( &n, tok.p, tok.end );
+    if (!n.exact || n.neg || n.scale > 16) {
+        double  val = str2float_strtod(tok.p, tok.end);
+        degrees = (int)(floor(val) / 100);
+        minutes = val - degrees*100.;
+        return degrees + minutes / 60.0;
+    }
+
+    unit    = pow10_int[n.scale] * 100;
+    degrees = (int)(n.mant / unit);
+    n.mant -= degrees * unit;
+    minutes = nmea_number_value( &n );
+    return degrees + minutes / 60.0;
 }
 
 
@@ -341,214 +780,1637 @@ nmea_reader_update_latlong( NmeaReader*  r,
     if (latitudeHemi == 'S')
         lat = -lat;
 
-    tok = longitude;
-    if (tok.p + 6 > tok.end) {
-        D("longitude is too short: '%.*s'", tok.end-tok.p, tok.p);
+    tok = longitude;
+    if (tok.p + 6 > tok.end) {
+        D("longitude is too short: '%.*s'", tok.end-tok.p, tok.p);
+        return -1;
+    }
+    lon = convert_from_hhmm(tok);
+    if (longitudeHemi == 'W')
+        lon = -lon;
+
+    r->fix.flags    |= GPS_LOCATION_HAS_LAT_LONG;
+    r->fix.latitude  = lat;
+    r->fix.longitude = lon;
+    return 0;
+}
+
+
+static int
+nmea_reader_update_altitude( NmeaReader*  r,
+                             Token        altitude,
+                             Token        units )
+{
+    double  alt;
+    Token   tok = altitude;
+
+    if (tok.p >= tok.end)
+        return -1;
+
+    r->fix.flags   |= GPS_LOCATION_HAS_ALTITUDE;
+    r->fix.altitude = str2float(tok.p, tok.end);
+    return 0;
+}
+
+
+static int
+nmea_reader_update_bearing( NmeaReader*  r,
+                            Token        bearing )
+{
+    double  alt;
+    Token   tok = bearing;
+
+    if (tok.p >= tok.end)
+        return -1;
+
+    r->fix.flags   |= GPS_LOCATION_HAS_BEARING;
+    r->fix.bearing  = str2float(tok.p, tok.end);
+    return 0;
+}
+
+
+/* speed in knots, as RMC and VTG give it */
+static int
+nmea_reader_update_speed( NmeaReader*  r,
+                          Token        speed )
+{
+    double  alt;
+    Token   tok = speed;
+
+    if (tok.p >= tok.end)
+        return -1;
+
+    r->fix.flags   |= GPS_LOCATION_HAS_SPEED;
+    r->fix.speed    = str2float(tok.p, tok.end) * 0.514444;
+    return 0;
+}
+
+
+/* hands the fix to the framework, or keeps it until there is a callback */
+static void
+nmea_reader_report_fix( NmeaReader*  r )
+{
+    if (r->fix.flags != 0) {
+        // accuracy from the horizontal dilution and a typical 5m range error
+        if ((r->fix.flags & (GPS_LOCATION_HAS_LAT_LONG|GPS_LOCATION_HAS_ACCURACY)) ==
+                GPS_LOCATION_HAS_LAT_LONG && r->hdop > 0) {
+            r->fix.flags   |= GPS_LOCATION_HAS_ACCURACY;
+            r->fix.accuracy = r->hdop * 5.0;
+        }
+#if GPS_DEBUG
+        char   temp[256];
+        char*  p   = temp;
+        char*  end = p + sizeof(temp);
+        struct tm   utc;
+
+        p += snprintf( p, end-p, "sending fix" );
+        if (r->fix.flags & GPS_LOCATION_HAS_LAT_LONG) {
+            p += snprintf(p, end-p, " lat=%g lon=%g", r->fix.latitude, r->fix.longitude);
+        }
+        if (r->fix.flags & GPS_LOCATION_HAS_ALTITUDE) {
+            p += snprintf(p, end-p, " altitude=%g", r->fix.altitude);
+        }
+        if (r->fix.flags & GPS_LOCATION_HAS_SPEED) {
+            p += snprintf(p, end-p, " speed=%g", r->fix.speed);
+        }
+        if (r->fix.flags & GPS_LOCATION_HAS_BEARING) {
+            p += snprintf(p, end-p, " bearing=%g", r->fix.bearing);
+        }
+        if (r->fix.flags & GPS_LOCATION_HAS_ACCURACY) {
+            p += snprintf(p,end-p, " accuracy=%g", r->fix.accuracy);
+        }
+        gmtime_r( (time_t*) &r->fix.timestamp, &utc );
+        p += snprintf(p, end-p, " time=%s", asctime( &utc ) );
+        D(temp);
+#endif
+        if (r->callback) {
+            if (r->batch && r->batch->latency > 0)
+                gps_batch_add( r->batch, &r->fix );
+            else
+                r->callback( &r->fix );
+            r->fix.flags = 0;
+            r->fix_sent  = 1;
+        }
+        else {
+            D("no callback, keeping data until needed !");
+        }
+    }
+}
+
+
+/* a fix is waiting for the rest of its epoch */
+static int
+nmea_reader_fix_pending( NmeaReader*  r )
+{
+    return r->fix.flags != 0 && !r->fix_sent && r->callback != NULL;
+}
+
+
+/* the sentences of an epoch are merged into one fix, sent once all the kinds
+ * the previous epoch had are in. the first epoch, and one missing a
+ * sentence, go out at the next epoch or after NMEA_EPOCH_TIMEOUT_MS */
+static void
+nmea_reader_update_fix_types( NmeaReader*  r, int  type )
+{
+    r->fix_types |= type;
+    if (!r->fix_sent && r->epoch_types != 0 &&
+            (r->fix_types & r->epoch_types) == r->epoch_types)
+        nmea_reader_report_fix( r );
+}
+
+
+/* one line of key=value pairs, the keys are kept stable for scripts */
+static int
+nmea_reader_format_stats( NmeaReader*  r, char*  buf, int  size )
+{
+    GpsBatch*  b = r->batch;
+    int        len, k;
+
+    len = snprintf( buf, size,
+        "sentences=%u bad_checksum=%u malformed=%u no_checksum=%u epochs=%u "
+        "parse_us=%lld us_per_epoch=%lld sentences_per_sec=%lld batches=%u batched=%u",
+        r->accepted, r->rejected, r->malformed, r->unchecked, r->epochs, r->scan_us,
+        r->epochs ? r->scan_us / r->epochs : 0,
+        r->scan_us ? r->accepted * 1000000LL / r->scan_us : 0,
+        b ? b->batches : 0, b ? b->locations : 0 );
+
+    for (k = 0; k < NMEA_KIND_COUNT && len < size; k++)
+        len += snprintf( buf + len, size - len, " %s=%u",
+                         nmea_kind_names[k], r->sentences[k] );
+    return len;
+}
+
+
+/* prn as the framework numbers them: glonass 65-96, beidou 201-, galileo 301- */
+static int
+nmea_sv_prn( const char*  talker, int  system, int  prn )
+{
+    if (system == 2 || (talker[0] == 'G' && talker[1] == 'L'))
+        return prn <= 32 ? prn + 64 : prn;
+    if (system == 3 || (talker[0] == 'G' && talker[1] == 'A'))
+        return prn <= 36 ? prn + 300 : prn;
+    if (system == 4 || (talker[0] == 'G' && talker[1] == 'B') ||
+                       (talker[0] == 'B' && talker[1] == 'D'))
+        return prn <= 63 ? prn + 200 : prn;
+    return prn;
+}
+
+
+/* report the satellites of the epoch that just ended, once */
+static void
+nmea_reader_flush_sv( NmeaReader*  r )
+{
+    // nobody looks at the sky view while batching
+    if (r->sv_pending && r->sv_callback &&
+            !(r->batch && r->batch->latency > 0)) {
+        r->sv.num_svs          = r->sv_ready;
+        r->sv.used_in_fix_mask = r->sv_used;
+        // nmea says nothing of ephemerides or almanacs
+        r->sv.ephemeris_mask   = 0;
+        r->sv.almanac_mask     = 0;
+        r->sv_callback( &r->sv );
+    }
+    r->sv.num_svs = 0;
+    r->sv_ready   = 0;
+    r->sv_next    = 0;
+    r->sv_pending = 0;
+    r->sv_used    = 0;
+}
+
+
+/* the epoch has data the framework has not seen yet */
+static int
+nmea_reader_epoch_pending( NmeaReader*  r )
+{
+    return nmea_reader_fix_pending( r ) || (r->sv_pending && r->sv_callback != NULL);
+}
+
+
+/* the receiver went quiet NMEA_EPOCH_TIMEOUT_MS after a read: the epoch is
+ * over, its fix and satellites go out without waiting for the next one */
+static void
+nmea_reader_epoch_timeout( NmeaReader*  r )
+{
+    if (nmea_reader_fix_pending( r ))
+        nmea_reader_report_fix( r );
+    if (r->sv_pending)
+        nmea_reader_flush_sv( r );
+}
+
+
+/* the time field of RMC and GGA marks the epoch, satellites are sent when
+ * it changes, or when the epoch times out */
+static void
+nmea_reader_update_epoch( NmeaReader*  r, Token  tok )
+{
+    int  len = tok.end - tok.p;
+
+    if (len <= 0)
+        return;
+    if (len > (int)sizeof(r->epoch))
+        len = sizeof(r->epoch);
+    if (len == r->epoch_len && !memcmp(r->epoch, tok.p, len))
+        return;
+
+    // what the last epoch had is what makes the next one complete
+    if (!r->fix_sent)
+        nmea_reader_report_fix( r );
+    else
+        r->fix.flags = 0;
+    if (!r->skipping)
+        r->epoch_types = r->fix_types;
+    r->fix_types   = 0;
+    r->fix_sent    = 0;
+
+    nmea_reader_flush_sv( r );
+    memcpy( r->epoch, tok.p, len );
+    r->epoch_len = len;
+    r->epochs   += 1;
+}
+
+
+static void
+nmea_reader_set_interval( NmeaReader*  r, int  interval )
+{
+    r->fix_interval = interval;
+    r->last_due     = -1;
+    r->skipping     = 0;
+}
+
+
+/* whether the epoch at time t, in ms wrapping at wrap, is sent */
+static int
+nmea_reader_due( NmeaReader*  r, long  t, long  wrap )
+{
+    long  diff;
+
+    if (r->fix_interval <= 0 || r->last_due < 0) {
+        r->last_due = t;
+        return 1;
+    }
+
+    diff = t - r->last_due;
+    if (diff < 0)
+        diff += wrap;
+    // not a time we can compare, the receiver changed protocol
+    if (diff < 0 || diff >= wrap) {
+        r->last_due = t;
+        return 1;
+    }
+
+    if (diff + NMEA_INTERVAL_SLACK_MS < r->fix_interval)
+        return 0;
+
+    r->last_due = t;
+    return 1;
+}
+
+
+/* between fixes only the time field of RMC and GGA is looked at, the other
+ * sentences of an epoch that is not due are dropped untokenized */
+static int
+nmea_reader_skip_sentence( NmeaReader*  r, const char*  p, const char*  end )
+{
+    Token  tok;
+    long   tod;
+    int    len;
+
+    // $ttSSS, with a two letter talker
+    if (end - p < 8 || p[6] != ',')
+        return r->skipping;
+    if (memcmp(p+3, "RMC", 3) && memcmp(p+3, "GGA", 3))
+        return r->skipping;
+
+    tok.p   = p + 7;
+    tok.end = memchr(tok.p, ',', end - tok.p);
+    if (tok.end == NULL || (tod = nmea_time_of_day(tok)) < 0)
+        return 0;
+
+    len = tok.end - tok.p;
+    if (len == r->epoch_len && !memcmp(r->epoch, tok.p, len))
+        return r->skipping;
+
+    nmea_reader_update_epoch( r, tok );
+    r->skipping = !nmea_reader_due( r, tod, 86400000L );
+    return r->skipping;
+}
+
+
+/* GSV: up to four satellites per sentence, a group of sentences for each
+ * constellation. a group missing a sentence is dropped */
+static void
+nmea_reader_update_sv( NmeaReader*  r, NmeaTokenizer*  tzer, const char*  talker )
+{
+    Token  tok_total = nmea_tokenizer_get(tzer,1);
+    Token  tok_num   = nmea_tokenizer_get(tzer,2);
+    int    total     = str2int(tok_total.p, tok_total.end);
+    int    num       = str2int(tok_num.p, tok_num.end);
+    int    i;
+
+    if (total <= 0 || num <= 0 || num > total)
+        return;
+
+    if (num == 1) {
+        r->sv.num_svs = r->sv_ready;
+        r->sv_next    = 1;
+    }
+    if (num != r->sv_next) {
+        D("GSV %d/%d out of sequence, group dropped", num, total);
+        r->sv.num_svs = r->sv_ready;
+        r->sv_next    = 0;
+        return;
+    }
+
+    // prn, elevation, azimuth, snr; a trailing signal id has no fields after it
+    for (i = 4; i + 2 < tzer->count; i += 4) {
+        Token       tok_prn = nmea_tokenizer_get(tzer,i);
+        Token       tok_elv = nmea_tokenizer_get(tzer,i+1);
+        Token       tok_azm = nmea_tokenizer_get(tzer,i+2);
+        Token       tok_snr = nmea_tokenizer_get(tzer,i+3);
+        int         prn     = str2int(tok_prn.p, tok_prn.end);
+        GpsSvInfo*  sv;
+
+        if (prn <= 0 || r->sv.num_svs >= GPS_MAX_SVS)
+            continue;
+
+        sv = &r->sv.sv_list[r->sv.num_svs++];
+        sv->size      = sizeof(*sv);
+        sv->prn       = nmea_sv_prn(talker, 0, prn);
+        sv->elevation = str2float(tok_elv.p, tok_elv.end);
+        sv->azimuth   = str2float(tok_azm.p, tok_azm.end);
+        sv->snr       = str2float(tok_snr.p, tok_snr.end);
+    }
+
+    if (num == total) {
+        r->sv_ready   = r->sv.num_svs;
+        r->sv_next    = 0;
+        r->sv_pending = 1;
+    } else {
+        r->sv_next = num + 1;
+    }
+}
+
+
+/* GSA: satellites used in the fix, and the dilutions of precision */
+static void
+nmea_reader_update_used( NmeaReader*  r, NmeaTokenizer*  tzer, const char*  talker )
+{
+    Token  tok_fix    = nmea_tokenizer_get(tzer,2);
+    Token  tok_pdop   = nmea_tokenizer_get(tzer,15);
+    Token  tok_hdop   = nmea_tokenizer_get(tzer,16);
+    Token  tok_vdop   = nmea_tokenizer_get(tzer,17);
+    Token  tok_system = nmea_tokenizer_get(tzer,18);
+    int    system     = str2int(tok_system.p, tok_system.end);
+    int    i;
+
+    if (tok_fix.p >= tok_fix.end || tok_fix.p[0] < '2')
+        return;
+
+    for (i = 3; i < 15; i++) {
+        Token  tok = nmea_tokenizer_get(tzer,i);
+        int    prn = str2int(tok.p, tok.end);
+
+        // the mask only has room for prn 1 to 32
+        if (prn > 0) {
+            prn = nmea_sv_prn(talker, system, prn);
+            if (prn <= 32)
+                r->sv_used |= 1u << (prn - 1);
+        }
+    }
+
+    r->pdop = str2float(tok_pdop.p, tok_pdop.end);
+    r->hdop = str2float(tok_hdop.p, tok_hdop.end);
+    r->vdop = str2float(tok_vdop.p, tok_vdop.end);
+}
+
+
+/* the handlers get the tokens of a sentence and return the NMEA_FIX_* it
+ * adds to the fix of the epoch, 0 if none */
+typedef int (*NmeaHandler)( NmeaReader*  r, NmeaTokenizer*  tzer, const char*  talker );
+
+static int
+nmea_reader_parse_gga( NmeaReader*  r, NmeaTokenizer*  tzer, const char*  talker )
+{
+    Token  tok_time          = nmea_tokenizer_get(tzer,1);
+    Token  tok_latitude      = nmea_tokenizer_get(tzer,2);
+    Token  tok_latitudeHemi  = nmea_tokenizer_get(tzer,3);
+    Token  tok_longitude     = nmea_tokenizer_get(tzer,4);
+    Token  tok_longitudeHemi = nmea_tokenizer_get(tzer,5);
+    Token  tok_hdop          = nmea_tokenizer_get(tzer,8);
+    Token  tok_altitude      = nmea_tokenizer_get(tzer,9);
+    Token  tok_altitudeUnits = nmea_tokenizer_get(tzer,10);
+
+    nmea_reader_update_epoch(r, tok_time);
+    if (tok_hdop.p < tok_hdop.end)
+        r->hdop = str2float(tok_hdop.p, tok_hdop.end);
+    nmea_reader_update_time(r, tok_time);
+    nmea_reader_update_latlong(r, tok_latitude,
+                                  tok_latitudeHemi.p[0],
+                                  tok_longitude,
+                                  tok_longitudeHemi.p[0]);
+    nmea_reader_update_altitude(r, tok_altitude, tok_altitudeUnits);
+    return NMEA_FIX_GGA;
+}
+
+static int
+nmea_reader_parse_rmc( NmeaReader*  r, NmeaTokenizer*  tzer, const char*  talker )
+{
+    Token  tok_time          = nmea_tokenizer_get(tzer,1);
+    Token  tok_fixStatus     = nmea_tokenizer_get(tzer,2);
+    Token  tok_latitude      = nmea_tokenizer_get(tzer,3);
+    Token  tok_latitudeHemi  = nmea_tokenizer_get(tzer,4);
+    Token  tok_longitude     = nmea_tokenizer_get(tzer,5);
+    Token  tok_longitudeHemi = nmea_tokenizer_get(tzer,6);
+    Token  tok_speed         = nmea_tokenizer_get(tzer,7);
+    Token  tok_bearing       = nmea_tokenizer_get(tzer,8);
+    Token  tok_date          = nmea_tokenizer_get(tzer,9);
+
+    nmea_reader_update_epoch(r, tok_time);
+    D("in RMC, fixStatus=%c", tok_fixStatus.p[0]);
+    if (tok_fixStatus.p[0] == 'A')
+    {
+        nmea_reader_update_date( r, tok_date, tok_time );
+
+        nmea_reader_update_latlong( r, tok_latitude,
+                                       tok_latitudeHemi.p[0],
+                                       tok_longitude,
+                                       tok_longitudeHemi.p[0] );
+
+        nmea_reader_update_bearing( r, tok_bearing );
+        nmea_reader_update_speed  ( r, tok_speed );
+    }
+    return NMEA_FIX_RMC;
+}
+
+static int
+nmea_reader_parse_gsa( NmeaReader*  r, NmeaTokenizer*  tzer, const char*  talker )
+{
+    nmea_reader_update_used(r, tzer, talker);
+    return NMEA_FIX_GSA;
+}
+
+static int
+nmea_reader_parse_gsv( NmeaReader*  r, NmeaTokenizer*  tzer, const char*  talker )
+{
+    nmea_reader_update_sv(r, tzer, talker);
+    return 0;
+}
+
+static int
+nmea_reader_parse_vtg( NmeaReader*  r, NmeaTokenizer*  tzer, const char*  talker )
+{
+    Token  tok_bearing       = nmea_tokenizer_get(tzer,1);
+    Token  tok_speed         = nmea_tokenizer_get(tzer,5);
+    Token  tok_mode          = nmea_tokenizer_get(tzer,9);
+
+    // no mode field before nmea 2.3
+    if (tok_mode.p == tok_mode.end || tok_mode.p[0] != 'N') {
+        nmea_reader_update_bearing( r, tok_bearing );
+        nmea_reader_update_speed  ( r, tok_speed );
+    }
+    return NMEA_FIX_VTG;
+}
+
+static int
+nmea_reader_parse_gll( NmeaReader*  r, NmeaTokenizer*  tzer, const char*  talker )
+{
+    Token  tok_latitude      = nmea_tokenizer_get(tzer,1);
+    Token  tok_latitudeHemi  = nmea_tokenizer_get(tzer,2);
+    Token  tok_longitude     = nmea_tokenizer_get(tzer,3);
+    Token  tok_longitudeHemi = nmea_tokenizer_get(tzer,4);
+    Token  tok_time          = nmea_tokenizer_get(tzer,5);
+    Token  tok_status        = nmea_tokenizer_get(tzer,6);
+
+    nmea_reader_update_epoch(r, tok_time);
+    if (tok_status.p[0] == 'A') {
+        nmea_reader_update_time(r, tok_time);
+        nmea_reader_update_latlong(r, tok_latitude,
+                                      tok_latitudeHemi.p[0],
+                                      tok_longitude,
+                                      tok_longitudeHemi.p[0]);
+    }
+    return NMEA_FIX_GLL;
+}
+
+static int
+nmea_reader_parse_zda( NmeaReader*  r, NmeaTokenizer*  tzer, const char*  talker )
+{
+    Token  tok_time          = nmea_tokenizer_get(tzer,1);
+    Token  tok_day           = nmea_tokenizer_get(tzer,2);
+    Token  tok_month         = nmea_tokenizer_get(tzer,3);
+    Token  tok_year          = nmea_tokenizer_get(tzer,4);
+    int    day, mon, year;
+    long   tod;
+
+    day  = str2int(tok_day.p,   tok_day.end);
+    mon  = str2int(tok_month.p, tok_month.end);
+    year = str2int(tok_year.p,  tok_year.end);
+    tod  = nmea_time_of_day(tok_time);
+    if (day < 1 || day > 31 || mon < 1 || mon > 12 || year < 1980 || tod < 0) {
+        D("ZDA date not properly formatted");
+        return 0;
+    }
+
+    // a four digit year and the time it goes with, the date other
+    // sentences are stamped with from now on
+    r->utc_zda  = 1;
+    r->utc_days = days_from_civil( year, mon, day );
+    r->utc_tod  = tod;
+    return 0;
+}
+
+/* the multi-constellation GGA, with one mode letter per constellation */
+static int
+nmea_reader_parse_gns( NmeaReader*  r, NmeaTokenizer*  tzer, const char*  talker )
+{
+    Token        tok_time          = nmea_tokenizer_get(tzer,1);
+    Token        tok_latitude      = nmea_tokenizer_get(tzer,2);
+    Token        tok_latitudeHemi  = nmea_tokenizer_get(tzer,3);
+    Token        tok_longitude     = nmea_tokenizer_get(tzer,4);
+    Token        tok_longitudeHemi = nmea_tokenizer_get(tzer,5);
+    Token        tok_mode          = nmea_tokenizer_get(tzer,6);
+    Token        tok_hdop          = nmea_tokenizer_get(tzer,8);
+    Token        tok_altitude      = nmea_tokenizer_get(tzer,9);
+    const char*  m;
+
+    nmea_reader_update_epoch(r, tok_time);
+
+    // no fix from any constellation
+    for (m = tok_mode.p; m < tok_mode.end && *m == 'N'; m++)
+        ;
+    if (m == tok_mode.end)
+        return NMEA_FIX_GNS;
+
+    if (tok_hdop.p < tok_hdop.end)
+        r->hdop = str2float(tok_hdop.p, tok_hdop.end);
+    nmea_reader_update_time(r, tok_time);
+    nmea_reader_update_latlong(r, tok_latitude,
+                                  tok_latitudeHemi.p[0],
+                                  tok_longitude,
+                                  tok_longitudeHemi.p[0]);
+    nmea_reader_update_altitude(r, tok_altitude, nmea_tokenizer_get(tzer,-1));
+    return NMEA_FIX_GNS;
+}
+
+/* $P and a maker id. nothing is taken from them yet, they are only counted */
+static int
+nmea_reader_parse_proprietary( NmeaReader*  r, NmeaTokenizer*  tzer, const char*  talker )
+{
+    return 0;
+}
+
+
+static const NmeaHandler  nmea_handlers[ NMEA_KIND_COUNT ] = {
+    [NMEA_KIND_GGA]         = nmea_reader_parse_gga,
+    [NMEA_KIND_RMC]         = nmea_reader_parse_rmc,
+    [NMEA_KIND_GSA]         = nmea_reader_parse_gsa,
+    [NMEA_KIND_GSV]         = nmea_reader_parse_gsv,
+    [NMEA_KIND_VTG]         = nmea_reader_parse_vtg,
+    [NMEA_KIND_GLL]         = nmea_reader_parse_gll,
+    [NMEA_KIND_ZDA]         = nmea_reader_parse_zda,
+    [NMEA_KIND_GNS]         = nmea_reader_parse_gns,
+    [NMEA_KIND_PROPRIETARY] = nmea_reader_parse_proprietary,
+};
+
+
+/* the sentence id, talker and type, is hashed into a table built by the
+ * compiler. the hash has no collision for the talkers and types below, keep
+ * it that way when adding some: an entry landing on another one replaces it,
+ * which -Werror=override-init in Android.mk turns into a build error */
+#define  NMEA_DISPATCH_SIZE  128
+
+#define  NMEA_HASH(t0,t1,s0,s1,s2) \
+    (((t0) ^ (t1) << 1 ^ (s0) << 3 ^ (s1) << 2 ^ (s2)) & (NMEA_DISPATCH_SIZE - 1))
+
+#define  NMEA_ENTRY(t0,t1,s0,s1,s2,kind) \
+    [NMEA_HASH(t0,t1,s0,s1,s2)] = { { t0, t1, s0, s1, s2 }, kind }
+
+#define  NMEA_TALKER(t0,t1) \
+    NMEA_ENTRY(t0,t1,'G','G','A', NMEA_KIND_GGA), \
+    NMEA_ENTRY(t0,t1,'R','M','C', NMEA_KIND_RMC), \
+    NMEA_ENTRY(t0,t1,'G','S','A', NMEA_KIND_GSA), \
+    NMEA_ENTRY(t0,t1,'G','S','V', NMEA_KIND_GSV), \
+    NMEA_ENTRY(t0,t1,'V','T','G', NMEA_KIND_VTG), \
+    NMEA_ENTRY(t0,t1,'G','L','L', NMEA_KIND_GLL), \
+    NMEA_ENTRY(t0,t1,'Z','D','A', NMEA_KIND_ZDA), \
+    NMEA_ENTRY(t0,t1,'G','N','S', NMEA_KIND_GNS)
+
+static const struct {
+    char           id[5];
+    unsigned char  kind;
+} nmea_dispatch[ NMEA_DISPATCH_SIZE ] = {
+    NMEA_TALKER('G','P'),       // gps
+    NMEA_TALKER('G','L'),       // glonass
+    NMEA_TALKER('G','A'),       // galileo
+    NMEA_TALKER('G','B'),       // beidou, nmea 4.11
+    NMEA_TALKER('B','D'),       // beidou
+    NMEA_TALKER('G','N'),       // combined
+};
+
+static int
+nmea_sentence_kind( Token  id )
+{
+    const unsigned char*  p = (const unsigned char*) id.p;
+    int                   slot;
+
+    if (id.p < id.end && p[0] == 'P')
+        return NMEA_KIND_PROPRIETARY;
+    if (id.end - id.p != 5)
+        return NMEA_KIND_UNKNOWN;
+
+    slot = NMEA_HASH(p[0], p[1], p[2], p[3], p[4]);
+    if (memcmp(nmea_dispatch[slot].id, p, 5))
+        return NMEA_KIND_UNKNOWN;
+    return nmea_dispatch[slot].kind;
+}
+
+
+/* returns -1 when the sentence fails the checks, 0 otherwise */
+static int
+nmea_reader_parse( NmeaReader*  r, const char*  p, const char*  end )
+{
+   /* we received a complete sentence, now parse it to generate
+    * a new GPS fix...
+    */
+    NmeaTokenizer  tzer[1];
+    Token          tok;
+    int            kind, type;
+
+    D("Received: '%.*s'", end-p, p);
+    if (end - p < 9) {
+        D("Too short. discarded.");
+        r->malformed += 1;
+        return -1;
+    }
+
+    // a corrupted sentence would give a bogus fix, drop it before any work
+    switch (nmea_sentence_check(p, end)) {
+    case NMEA_SENTENCE_OK:
+        r->checksummed = 1;
+        r->accepted += 1;
+        break;
+    case NMEA_SENTENCE_UNCHECKED:
+        // the checksum is optional in NMEA 0183, but a receiver that sends it
+        // does so on every sentence: one without is cut before its '*'
+        if (r->checksummed && !r->nochecksum) {
+            D("no checksum in a checksummed stream. discarded.");
+            r->malformed += 1;
+            return -1;
+        }
+        D("no checksum. parsed anyway.");
+        r->unchecked += 1;
+        r->accepted += 1;
+        break;
+    case NMEA_SENTENCE_CORRUPT:
+        D("bad checksum. discarded.");
+        r->rejected += 1;
+        return -1;
+    default:
+        D("damaged checksum field. discarded.");
+        r->malformed += 1;
+        return -1;
+    }
+
+    // a u-blox receiver sends both, its binary fixes are the more precise
+    if (r->ubx_active) {
+        if (++r->nmea_idle < UBX_IDLE_SENTENCES)
+            return 0;
+        D("no ubx fix lately, back to nmea");
+        r->ubx_active = 0;
+    }
+
+    if (r->fix_interval > 0 && nmea_reader_skip_sentence(r, p, end))
+        return 0;
+
+    nmea_tokenizer_init(tzer, p, end);
+#if GPS_DEBUG
+    {
+        int  n;
+        D("Found %d tokens", tzer->count);
+        for (n = 0; n < tzer->count; n++) {
+            Token  tok = nmea_tokenizer_get(tzer,n);
+            D("%2d: '%.*s'", n, tok.end-tok.p, tok.p);
+        }
+    }
+#endif
+
+    tok  = nmea_tokenizer_get(tzer, 0);
+    kind = nmea_sentence_kind(tok);
+    r->sentences[kind] += 1;
+    if (kind == NMEA_KIND_UNKNOWN) {
+        D("unknown sentence '%.*s", tok.end-tok.p, tok.p);
+        return 0;
+    }
+
+    type = nmea_handlers[kind](r, tzer, tok.p);
+    if (type != 0)
+        nmea_reader_update_fix_types( r, type );
+    return 0;
+}
+
+
+/*****************************************************************/
+/*****************************************************************/
+/*****                                                       *****/
+/*****       U B X   P A R S E R                             *****/
+/*****                                                       *****/
+/*****************************************************************/
+/*****************************************************************/
+
+static int
+ubx_u2( const unsigned char*  p )
+{
+    return p[0] | (p[1] << 8);
+}
+
+static int32_t
+ubx_i4( const unsigned char*  p )
+{
+    return (int32_t)(p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+/* prn as the framework numbers them, from the ubx gnss id; 0 if it has none */
+static int
+ubx_sv_prn( int  gnss, int  sv )
+{
+    switch (gnss) {
+    case 0:  return sv;                             // gps
+    case 1:  return sv >= 120 ? sv - 87 : sv;       // sbas 33-64
+    case 2:  return sv + 300;                       // galileo
+    case 3:  return sv + 200;                       // beidou
+    case 5:  return sv + 192;                       // qzss
+    case 6:  return sv <= 32 ? sv + 64 : sv;        // glonass
+    }
+    return 0;
+}
+
+
+/* NAV-PVT: time, position and velocity of one epoch */
+static void
+ubx_reader_update_pvt( NmeaReader*  r, const unsigned char*  p )
+{
+    int        valid = p[11];
+    int        type  = p[20];
+    int        flags = p[21];
+    long       days, tod;
+
+    r->ubx_active = 1;
+    r->nmea_idle  = 0;
+    r->epochs    += 1;
+
+    // gnss fix ok, 2d, 3d or combined with dead reckoning
+    if (!(flags & 0x01) || type < 2 || type > 4)
+        return;
+
+    // validDate and validTime: without them the fix would carry the time of
+    // the last one, it is not reported at all
+    if ((valid & 0x03) != 0x03)
+        return;
+
+    days = days_from_civil( ubx_u2(p+4), p[6], p[7] );
+    tod  = ((p[8] * 60 + p[9]) * 60 + p[10]) * 1000L;
+
+    // nano is signed, the seconds are rounded to the nearest
+    r->fix.timestamp = (long long)days * 86400000 + tod + ubx_i4(p+16) / 1000000;
+
+    r->fix.flags    |= GPS_LOCATION_HAS_LAT_LONG;
+    r->fix.longitude = ubx_i4(p+24) * 1e-7;
+    r->fix.latitude  = ubx_i4(p+28) * 1e-7;
+
+    if (type != 2) {
+        r->fix.flags   |= GPS_LOCATION_HAS_ALTITUDE;
+        r->fix.altitude = ubx_i4(p+36) * 1e-3;      // above mean sea level, as GGA
+    }
+
+    r->fix.flags   |= GPS_LOCATION_HAS_SPEED | GPS_LOCATION_HAS_BEARING |
+                      GPS_LOCATION_HAS_ACCURACY;
+    r->fix.speed    = ubx_i4(p+60) * 1e-3;
+    r->fix.bearing  = ubx_i4(p+64) * 1e-5;
+    r->fix.accuracy = (uint32_t)ubx_i4(p+40) * 1e-3;
+}
+
+
+/* NAV-SAT: every satellite of the epoch in one message */
+static void
+ubx_reader_update_sat( NmeaReader*  r, const unsigned char*  p, int  len )
+{
+    int  count = p[5];
+    int  i;
+
+    if (8 + 12*count > len)
+        return;
+
+    r->sv.num_svs = 0;
+    r->sv_used    = 0;
+    for (i = 0; i < count && r->sv.num_svs < GPS_MAX_SVS; i++) {
+        const unsigned char*  q   = p + 8 + 12*i;
+        int                   prn = ubx_sv_prn(q[0], q[1]);
+        GpsSvInfo*            sv;
+
+        if (prn <= 0)
+            continue;
+
+        sv = &r->sv.sv_list[r->sv.num_svs++];
+        sv->size      = sizeof(*sv);
+        sv->prn       = prn;
+        sv->snr       = q[2];
+        sv->elevation = (signed char)q[3];
+        sv->azimuth   = (int16_t)ubx_u2(q+4);
+
+        if ((q[8] & 0x08) && prn <= 32)
+            r->sv_used |= 1u << (prn - 1);
+    }
+
+    r->sv_ready   = r->sv.num_svs;
+    r->sv_pending = 1;
+    nmea_reader_flush_sv( r );
+}
+
+
+/* CFG-RATE limits: measurement period, and measurements per solution */
+#define  UBX_MEAS_MIN_MS     50      /* 20Hz */
+#define  UBX_MEAS_MAX_MS     10000
+#define  UBX_NAV_MAX_CYCLES  127
+
+/* asks a u-blox receiver for one solution every period ms, as near as the
+ * limits allow */
+static int
+ubx_send_rate( int  fd, int  period )
+{
+    unsigned char  f[6 + 6 + 2];
+    unsigned       ck_a = 0, ck_b = 0;
+    int            meas = period, nav = 1, i, ret;
+
+    // the measurement rate tops out at 10s on some parts, cycles do the rest
+    if (meas > UBX_MEAS_MAX_MS) {
+        nav  = (period + UBX_MEAS_MAX_MS - 1) / UBX_MEAS_MAX_MS;
+        if (nav > UBX_NAV_MAX_CYCLES)
+            nav = UBX_NAV_MAX_CYCLES;
+        meas = period / nav;
+        if (meas > UBX_MEAS_MAX_MS)
+            meas = UBX_MEAS_MAX_MS;
+    } else if (meas < UBX_MEAS_MIN_MS) {
+        meas = UBX_MEAS_MIN_MS;
+    }
+
+    f[0] = UBX_SYNC1;
+    f[1] = UBX_SYNC2;
+    f[2] = UBX_CLASS_CFG;
+    f[3] = UBX_CFG_RATE;
+    f[4] = 6;
+    f[5] = 0;
+    f[6] = meas & 0xff;
+    f[7] = meas >> 8;
+    f[8] = nav;
+    f[9] = 0;
+    f[10] = 1;      // gps time
+    f[11] = 0;
+    for (i = 2; i < 12; i++) {
+        ck_a += f[i];
+        ck_b += ck_a;
+    }
+    f[12] = ck_a;
+    f[13] = ck_b;
+
+    do {
+        ret = write( fd, f, sizeof(f) );
+    } while (ret < 0 && errno == EINTR);
+
+    D("ubx rate %d ms x %d: %d", meas, nav, ret);
+    return ret == (int)sizeof(f) ? 0 : -1;
+}
+
+
+/* f is a whole frame of len payload bytes, returns -1 on a bad checksum */
+static int
+ubx_reader_parse( NmeaReader*  r, const unsigned char*  f, int  len )
+{
+    const unsigned char*  p   = f + 6;
+    const unsigned char*  end = p + len;
+    const unsigned char*  q;
+    unsigned              ck_a = 0, ck_b = 0;
+    long                  itow;
+
+    // 8-bit fletcher over class, id, length and payload; only the low bytes matter
+    for (q = f + 2; q < end; q++) {
+        ck_a += *q;
+        ck_b += ck_a;
+    }
+    if ((ck_a & 0xff) != end[0] || (ck_b & 0xff) != end[1]) {
+        D("ubx %02x-%02x bad checksum. discarded.", f[2], f[3]);
+        r->rejected += 1;
+        return -1;
+    }
+    r->accepted += 1;
+
+    if (f[2] != UBX_CLASS_NAV || len < 4)
+        return 0;
+
+    // both carry the time of week of their epoch, only due epochs are decoded
+    itow = (uint32_t)ubx_i4(p);
+    if (f[3] == UBX_NAV_PVT && len >= 92) {
+        if (r->ubx_itow >= 0 && itow > r->ubx_itow)
+            r->ubx_period = itow - r->ubx_itow;
+        r->ubx_itow = itow;
+        if (!nmea_reader_due( r, itow, 604800000L )) {
+            r->ubx_active = 1;
+            r->nmea_idle  = 0;
+            return 0;
+        }
+        ubx_reader_update_pvt( r, p );
+        nmea_reader_report_fix( r );
+    } else if (f[3] == UBX_NAV_SAT && len >= 8) {
+        if (r->fix_interval > 0 && itow != r->last_due)
+            return 0;
+        ubx_reader_update_sat( r, p, len );
+    }
+    return 0;
+}
+
+
+/*****************************************************************/
+/*****************************************************************/
+/*****                                                       *****/
+/*****       I N P U T   S T R E A M                         *****/
+/*****                                                       *****/
+/*****************************************************************/
+/*****************************************************************/
+
+/* count new bytes were read at in+pos: parse every complete nmea sentence or
+ * ubx frame where it lies, then move an incomplete one to the start of the
+ * buffer. each one is told apart by its first byte, so a receiver may send
+ * either protocol or both. bytes outside them are skipped, as is a sentence
+ * longer than NMEA_MAX_SIZE.
+ */
+static void
+nmea_reader_scan( NmeaReader*  r, int  count )
+{
+    char*  p   = r->in;
+    char*  end = r->in + r->pos + count;
+    char*  q;
+
+    while (p < end) {
+        int  c = (unsigned char)*p;
+
+        if (c == '$') {
+            q = memchr(p, '\n', end - p);
+            if (q == NULL) {
+                if (end - p <= NMEA_MAX_SIZE)
+                    break;
+                D("sentence too long, discarded");
+                p += 1;
+                continue;
+            }
+            q += 1;
+            if (q - p > NMEA_MAX_SIZE) {
+                D("sentence too long, discarded");
+                p += 1;
+                continue;
+            }
+            // '$' may also be a byte of a ubx frame being resynced
+            if (nmea_reader_parse( r, p, q ) < 0 && memchr(p, UBX_SYNC1, q - p) != NULL)
+                p += 1;
+            else
+                p = q;
+        } else if (c == UBX_SYNC1) {
+            int  len;
+
+            if (end - p < 6)
+                break;
+            if ((unsigned char)p[1] != UBX_SYNC2) {
+                p += 1;
+                continue;
+            }
+            len = ubx_u2((const unsigned char*)p + 4);
+            if (len > UBX_MAX_PAYLOAD) {
+                r->malformed += 1;
+                p += 1;
+                continue;
+            }
+            if (end - p < len + 8)
+                break;
+            // a bad frame may have a bad length too, resync from the next byte
+            if (ubx_reader_parse( r, (const unsigned char*)p, len ) < 0)
+                p += 1;
+            else
+                p += len + 8;
+        } else {
+            // line ends, noise, or the rest of a dropped sentence
+            do {
+                p += 1;
+            } while (p < end && *p != '$' && (unsigned char)*p != UBX_SYNC1);
+        }
+    }
+
+    r->pos = end - p;
+    if (r->pos > 0 && p != r->in)
+        memmove( r->in, p, r->pos );
+}
+
+
+/*****************************************************************/
+/*****************************************************************/
+/*****                                                       *****/
+/*****       S E R I A L   R E C E I V E R                   *****/
+/*****                                                       *****/
+/*****************************************************************/
+/*****************************************************************/
+
+/* looks up KEY=value in gps.conf, returns 0 when found */
+static int
+gps_conf_get( const char*  key, char*  value, int  size )
+{
+    FILE*  f = fopen( GPS_CONF_FILE, "r" );
+    char   line[128];
+    int    keylen = strlen(key);
+    int    ret = -1;
+
+    if (f == NULL)
+        return -1;
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char*  p = line;
+        char*  end;
+
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (strncmp(p, key, keylen) != 0 || p[keylen] != '=')
+            continue;
+
+        p  += keylen + 1;
+        end = p + strcspn(p, " \t\r\n#");
+        *end = 0;
+        if (end > p && end - p < size) {
+            memcpy( value, p, end - p + 1 );
+            ret = 0;
+        }
+        break;
+    }
+    fclose(f);
+    return ret;
+}
+
+static speed_t
+gps_uart_speed( int  baud )
+{
+    static const struct { int baud; speed_t speed; } speeds[] = {
+        {   4800, B4800   }, {   9600, B9600   }, {  19200, B19200  },
+        {  38400, B38400  }, {  57600, B57600  }, { 115200, B115200 },
+        { 230400, B230400 }, { 460800, B460800 }, { 921600, B921600 },
+    };
+    unsigned  nn;
+
+    for (nn = 0; nn < sizeof(speeds)/sizeof(speeds[0]); nn++) {
+        if (speeds[nn].baud == baud)
+            return speeds[nn].speed;
+    }
+    return 0;
+}
+
+/* whether a switch is set by its property, or else by its gps.conf key */
+static int
+gps_conf_flag( const char*  prop, const char*  key )
+{
+    char  value[PROPERTY_VALUE_MAX];
+
+    if (property_get(prop, value, "") > 0 ||
+        gps_conf_get(key, value, sizeof(value)) == 0)
+        return atoi(value) != 0;
+    return 0;
+}
+
+/* opens the receiver tty named by ro.kernel.android.gps, or GPS_DEVICE in
+ * gps.conf, at ro.kernel.android.gps.speed or GPS_BAUD. returns -1 when no
+ * receiver is configured or the port can't be set up */
+static int
+gps_uart_open( void )
+{
+    char            device[PROPERTY_VALUE_MAX];
+    char            path[PROPERTY_VALUE_MAX + 8];
+    char            value[PROPERTY_VALUE_MAX];
+    struct termios  tio;
+    speed_t         speed;
+    int             baud = GPS_DEFAULT_BAUD;
+    int             fd;
+
+    if (property_get("ro.kernel.android.gps", device, "") <= 0 &&
+        gps_conf_get("GPS_DEVICE", device, sizeof(device)) < 0)
+        return -1;
+
+    if (property_get("ro.kernel.android.gps.speed", value, "") > 0 ||
+        gps_conf_get("GPS_BAUD", value, sizeof(value)) == 0)
+        baud = atoi(value);
+
+    speed = gps_uart_speed(baud);
+    if (speed == 0) {
+        LOGE("unsupported gps baud rate %d, using %d", baud, GPS_DEFAULT_BAUD);
+        baud  = GPS_DEFAULT_BAUD;
+        speed = gps_uart_speed(baud);
+    }
+
+    // the property names the tty alone, as for the emulator
+    if (device[0] == '/')
+        snprintf( path, sizeof(path), "%s", device );
+    else
+        snprintf( path, sizeof(path), "/dev/%s", device );
+
+    do {
+        fd = open( path, O_RDWR | O_NOCTTY | O_NONBLOCK );
+    } while (fd < 0 && errno == EINTR);
+
+    if (fd < 0) {
+        LOGE("could not open gps serial device %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    if (tcgetattr(fd, &tio) < 0) {
+        LOGE("%s is not a serial device: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    // raw 8N1, no flow control, no echo and no line editing
+    cfmakeraw(&tio);
+    tio.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+    tio.c_cflag |= CLOCAL | CREAD;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+
+    /* the fd is polled and then drained without blocking. a VMIN above 1
+     * would also hold back poll until that many bytes are queued, which can
+     * stall the tail of a burst until the next one; the read loop already
+     * takes a whole burst per wakeup. */
+    tio.c_cc[VMIN]  = 1;
+    tio.c_cc[VTIME] = 0;
+
+    if (tcsetattr(fd, TCSANOW, &tio) < 0) {
+        LOGE("could not configure %s: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    tcflush(fd, TCIFLUSH);
+
+    D("gps receiver on %s at %d baud", path, baud);
+    return fd;
+}
+
+
+/*****************************************************************/
+/*****************************************************************/
+/*****                                                       *****/
+/*****       R E C O R D   A N D   R E P L A Y               *****/
+/*****                                                       *****/
+/*****************************************************************/
+/*****************************************************************/
+
+/* debug.gps.record names a file that gets every byte read from the receiver.
+ * debug.gps.replay names such a file to play back instead of a receiver, at
+ * debug.gps.replay.speed times real time, 0 for as fast as it is read.
+ *
+ * the file is GPS_LOG_MAGIC followed by records of
+ *     varint  microseconds since the previous record (CLOCK_MONOTONIC)
+ *     varint  length
+ *     bytes   data as read
+ * varints are 7 bits per byte, low bits first, top bit set when more follow.
+ */
+#define  GPS_LOG_MAGIC      "GPSLOG1\n"
+#define  GPS_LOG_MAGIC_LEN  8
+
+typedef struct {
+    int         fd;
+    long long   last_us;
+} GpsRecord;
+
+typedef struct {
+    pthread_t     thread;
+    FILE*         log;
+    int           fd;       /* our end of the socket the gps thread reads */
+    int           speed;
+    volatile int  quit;
+} GpsReplay;
+
+static long long
+gps_monotonic_us( void )
+{
+    struct timespec  ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int
+gps_log_put_varint( unsigned char*  p, unsigned long long  v )
+{
+    int  n = 0;
+
+    do {
+        p[n++] = (v & 0x7f) | (v >= 0x80 ? 0x80 : 0);
+        v >>= 7;
+    } while (v != 0);
+    return n;
+}
+
+static int
+gps_log_get_varint( FILE*  f, unsigned long long*  v )
+{
+    int  shift = 0;
+    int  c;
+
+    *v = 0;
+    do {
+        c = getc(f);
+        if (c == EOF || shift > 63)
+            return -1;
+        *v |= (unsigned long long)(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    return 0;
+}
+
+static void
+gps_record_open( GpsRecord*  rec )
+{
+    char  path[PROPERTY_VALUE_MAX];
+
+    rec->fd = -1;
+    if (property_get("debug.gps.record", path, "") <= 0)
+        return;
+
+    rec->fd = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    if (rec->fd < 0) {
+        LOGE("could not create gps record file %s: %s", path, strerror(errno));
+        return;
+    }
+    write( rec->fd, GPS_LOG_MAGIC, GPS_LOG_MAGIC_LEN );
+    rec->last_us = gps_monotonic_us();
+    LOGI("recording gps data to %s", path);
+}
+
+static void
+gps_record_write( GpsRecord*  rec, const char*  data, int  len )
+{
+    unsigned char  head[20];
+    struct iovec   iov[2];
+    long long      now = gps_monotonic_us();
+    int            n;
+
+    n  = gps_log_put_varint( head, now - rec->last_us );
+    n += gps_log_put_varint( head + n, len );
+    rec->last_us = now;
+
+    iov[0].iov_base = head;
+    iov[0].iov_len  = n;
+    iov[1].iov_base = (void*)data;
+    iov[1].iov_len  = len;
+    if (writev( rec->fd, iov, 2 ) != n + len) {
+        LOGE("gps record write failed, recording stopped: %s", strerror(errno));
+        close( rec->fd );
+        rec->fd = -1;
+    }
+}
+
+static void
+gps_record_close( GpsRecord*  rec )
+{
+    if (rec->fd >= 0) {
+        close( rec->fd );
+        rec->fd = -1;
+    }
+}
+
+/* sleeps until the monotonic time due, in slices so a quit is seen */
+static void
+gps_replay_wait( GpsReplay*  rp, long long  due )
+{
+    long long  left;
+
+    while (!rp->quit && (left = due - gps_monotonic_us()) > 0) {
+        struct timespec  ts;
+
+        if (left > 100000)
+            left = 100000;
+        ts.tv_sec  = 0;
+        ts.tv_nsec = left * 1000;
+        nanosleep( &ts, NULL );
+    }
+}
+
+static void*
+gps_replay_thread( void*  arg )
+{
+    GpsReplay*          rp    = (GpsReplay*) arg;
+    long long           start = gps_monotonic_us();
+    unsigned long long  delta, len, at = 0;
+    unsigned            records = 0;
+    char                data[NMEA_BUFF_SIZE];
+
+    while (!rp->quit) {
+        const char*  p;
+        int          ret;
+
+        if (gps_log_get_varint(rp->log, &delta) < 0 ||
+            gps_log_get_varint(rp->log, &len) < 0)
+            break;
+        if (len > sizeof(data) || fread(data, 1, len, rp->log) != len) {
+            LOGE("gps replay: truncated record %u", records);
+            break;
+        }
+
+        at += delta;
+        if (rp->speed > 0)
+            gps_replay_wait( rp, start + at / rp->speed );
+
+        for (p = data; p < data + len && !rp->quit; p += ret) {
+            // no SIGPIPE when the gps thread has gone
+            ret = send( rp->fd, p, data + len - p, MSG_NOSIGNAL );
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    ret = 0;
+                    continue;
+                }
+                goto Exit;
+            }
+        }
+        records += 1;
+    }
+Exit:
+    LOGI("gps replay: %u records in %lld ms", records,
+         (gps_monotonic_us() - start) / 1000);
+    // the gps thread sees the end of the stream and quits
+    shutdown( rp->fd, SHUT_WR );
+    return NULL;
+}
+
+/* returns the fd the gps thread reads the replay from, -1 if there is none */
+static int
+gps_replay_start( GpsReplay*  rp )
+{
+    char  path[PROPERTY_VALUE_MAX];
+    char  value[PROPERTY_VALUE_MAX];
+    char  magic[GPS_LOG_MAGIC_LEN];
+    int   fds[2];
+
+    rp->log = NULL;
+    rp->fd  = -1;
+    rp->quit = 0;
+    if (property_get("debug.gps.replay", path, "") <= 0)
+        return -1;
+
+    property_get("debug.gps.replay.speed", value, "1");
+    rp->speed = atoi(value);
+    if (rp->speed < 0)
+        rp->speed = 1;
+
+    rp->log = fopen( path, "rb" );
+    if (rp->log == NULL) {
+        LOGE("could not open gps replay file %s: %s", path, strerror(errno));
         return -1;
     }
-    lon = convert_from_hhmm(tok);
-    if (longitudeHemi == 'W')
-        lon = -lon;
+    if (fread(magic, 1, sizeof(magic), rp->log) != sizeof(magic) ||
+        memcmp(magic, GPS_LOG_MAGIC, sizeof(magic)) != 0) {
+        LOGE("%s is not a gps record file", path);
+        goto Fail;
+    }
 
-    r->fix.flags    |= GPS_LOCATION_HAS_LAT_LONG;
-    r->fix.latitude  = lat;
-    r->fix.longitude = lon;
-    return 0;
-}
+    if ( socketpair( AF_LOCAL, SOCK_STREAM, 0, fds ) < 0 ) {
+        LOGE("could not create gps replay socket pair: %s", strerror(errno));
+        goto Fail;
+    }
+    rp->fd = fds[0];
 
+    if ( pthread_create( &rp->thread, NULL, gps_replay_thread, rp ) != 0 ) {
+        LOGE("could not create gps replay thread: %s", strerror(errno));
+        close( fds[0] );
+        close( fds[1] );
+        rp->fd = -1;
+        goto Fail;
+    }
 
-static int
-nmea_reader_update_altitude( NmeaReader*  r,
-                             Token        altitude,
-                             Token        units )
-{
-    double  alt;
-    Token   tok = altitude;
+    LOGI("replaying gps data from %s at speed %d", path, rp->speed);
+    return fds[1];
 
-    if (tok.p >= tok.end)
-        return -1;
+Fail:
+    fclose( rp->log );
+    rp->log = NULL;
+    return -1;
+}
 
-    r->fix.flags   |= GPS_LOCATION_HAS_ALTITUDE;
-    r->fix.altitude = str2float(tok.p, tok.end);
-    return 0;
+static void
+gps_replay_stop( GpsReplay*  rp )
+{
+    if (rp->log == NULL)
+        return;
+
+    rp->quit = 1;
+    shutdown( rp->fd, SHUT_RDWR );
+    pthread_join( rp->thread, NULL );
+    close( rp->fd );
+    rp->fd = -1;
+    fclose( rp->log );
+    rp->log = NULL;
 }
 
 
-static int
-nmea_reader_update_bearing( NmeaReader*  r,
-                            Token        bearing )
-{
-    double  alt;
-    Token   tok = bearing;
+/*****************************************************************/
+/*****************************************************************/
+/*****                                                       *****/
+/*****       C A L L B A C K   Q U E U E                     *****/
+/*****                                                       *****/
+/*****************************************************************/
+/*****************************************************************/
 
-    if (tok.p >= tok.end)
-        return -1;
+/* the framework callbacks run on a thread of their own, so a slow one
+ * never holds up reading the receiver. the gps thread is the only writer
+ * and never waits: when the ring is full the oldest entry is overwritten.
+ * each slot has a sequence number, odd while it is written, that tells the
+ * dispatch thread whether what it copied is still the entry it expected */
+#define  GPS_QUEUE_SIZE  16     /* a power of two */
 
-    r->fix.flags   |= GPS_LOCATION_HAS_BEARING;
-    r->fix.bearing  = str2float(tok.p, tok.end);
-    return 0;
-}
+enum {
+    GPS_QUEUE_LOCATION = 0,
+    GPS_QUEUE_SV_STATUS,
+};
 
+typedef struct {
+    volatile unsigned  seq;     /* 2*index+2 once entry index is complete */
+    int                type;
+    union {
+        GpsLocation    location;
+        GpsSvStatus    sv;
+    } u;
+} GpsQueueItem;
 
-static int
-nmea_reader_update_speed( NmeaReader*  r,
-                          Token        speed )
-{
-    double  alt;
-    Token   tok = speed;
+typedef struct {
+    GpsQueueItem         items[ GPS_QUEUE_SIZE ];
+    volatile unsigned    head;          /* entries pushed, gps thread */
+    volatile unsigned    tail;          /* entries taken, dispatch thread */
+    unsigned             max_depth;     /* gps thread */
+    volatile unsigned    dropped;       /* dispatch thread */
+    const GpsCallbacks*  callbacks;
+    pthread_t            thread;
+    int                  wake[2];       /* a byte per entry pushed */
+} GpsQueue;
 
-    if (tok.p >= tok.end)
-        return -1;
+static GpsQueue  _gps_queue[1];
 
-    r->fix.flags   |= GPS_LOCATION_HAS_SPEED;
-    r->fix.speed    = str2float(tok.p, tok.end);
-    return 0;
+
+static void
+gps_queue_push( GpsQueue*  q, int  type, const void*  data, size_t  size )
+{
+    unsigned       head  = q->head;
+    GpsQueueItem*  slot  = &q->items[ head & (GPS_QUEUE_SIZE - 1) ];
+    unsigned       depth;
+    int            ret;
+
+    slot->seq = head*2 + 1;
+    __sync_synchronize();
+    slot->type = type;
+    memcpy( &slot->u, data, size );
+    __sync_synchronize();
+    slot->seq = head*2 + 2;
+    __sync_synchronize();
+    q->head = head + 1;
+
+    depth = head + 1 - q->tail;
+    if (depth > GPS_QUEUE_SIZE)
+        depth = GPS_QUEUE_SIZE;
+    if (depth > q->max_depth)
+        q->max_depth = depth;
+
+    // the pipe is non-blocking, when full the dispatch thread is awake anyway
+    do {
+        ret = write( q->wake[1], "", 1 );
+    } while (ret < 0 && errno == EINTR);
 }
 
 
 static void
-nmea_reader_parse( NmeaReader*  r )
+gps_queue_drain( GpsQueue*  q )
 {
-   /* we received a complete sentence, now parse it to generate
-    * a new GPS fix...
-    */
-    NmeaTokenizer  tzer[1];
-    Token          tok;
+    const GpsCallbacks*  cbs = q->callbacks;
+    GpsQueueItem         item;
 
-    D("Received: '%.*s'", r->pos, r->in);
-    if (r->pos < 9) {
-        D("Too short. discarded.");
-        return;
-    }
+    for (;;) {
+        unsigned       head, tail, seq;
+        GpsQueueItem*  slot;
+
+        head = q->head;
+        __sync_synchronize();
+        tail = q->tail;
+        if (tail == head)
+            return;
+
+        // lapped by the gps thread, those entries are gone
+        if (head - tail > GPS_QUEUE_SIZE) {
+            q->dropped += head - tail - GPS_QUEUE_SIZE;
+            tail = head - GPS_QUEUE_SIZE;
+        }
 
-    nmea_tokenizer_init(tzer, r->in, r->in + r->pos);
-#if GPS_DEBUG
-    {
-        int  n;
-        D("Found %d tokens", tzer->count);
-        for (n = 0; n < tzer->count; n++) {
-            Token  tok = nmea_tokenizer_get(tzer,n);
-            D("%2d: '%.*s'", n, tok.end-tok.p, tok.p);
+        slot = &q->items[ tail & (GPS_QUEUE_SIZE - 1) ];
+        seq  = slot->seq;
+        __sync_synchronize();
+        item.type = slot->type;
+        if (item.type == GPS_QUEUE_LOCATION)
+            memcpy( &item.u.location, &slot->u.location, sizeof(item.u.location) );
+        else
+            memcpy( &item.u.sv, &slot->u.sv, sizeof(item.u.sv) );
+        __sync_synchronize();
+
+        if (seq != tail*2 + 2 || slot->seq != seq) {
+            q->dropped += 1;
+        } else if (item.type == GPS_QUEUE_LOCATION) {
+            if (cbs->location_cb)
+                cbs->location_cb( &item.u.location );
+        } else {
+            if (cbs->sv_status_cb)
+                cbs->sv_status_cb( &item.u.sv );
         }
+        __sync_synchronize();
+        q->tail = tail + 1;
     }
-#endif
+}
 
-    tok = nmea_tokenizer_get(tzer, 0);
-    if (tok.p + 5 > tok.end) {
-        D("sentence id '%.*s' too short, ignored.", tok.end-tok.p, tok.p);
-        return;
+
+static void*
+gps_queue_thread( void*  arg )
+{
+    GpsQueue*  q = arg;
+    char       buff[64];
+    int        ret;
+
+    // the write end is closed to stop the thread, what is queued goes first
+    for (;;) {
+        ret = read( q->wake[0], buff, sizeof(buff) );
+        if (ret < 0 && errno == EINTR)
+            continue;
+        gps_queue_drain( q );
+        if (ret <= 0)
+            break;
     }
+    D("gps dispatch thread quitting");
+    return NULL;
+}
 
-    // ignore first two characters.
-    tok.p += 2;
-    if ( !memcmp(tok.p, "GGA", 3) ) {
-        // GPS fix
-        Token  tok_time          = nmea_tokenizer_get(tzer,1);
-        Token  tok_latitude      = nmea_tokenizer_get(tzer,2);
-        Token  tok_latitudeHemi  = nmea_tokenizer_get(tzer,3);
-        Token  tok_longitude     = nmea_tokenizer_get(tzer,4);
-        Token  tok_longitudeHemi = nmea_tokenizer_get(tzer,5);
-        Token  tok_altitude      = nmea_tokenizer_get(tzer,9);
-        Token  tok_altitudeUnits = nmea_tokenizer_get(tzer,10);
 
-        nmea_reader_update_time(r, tok_time);
-        nmea_reader_update_latlong(r, tok_latitude,
-                                      tok_latitudeHemi.p[0],
-                                      tok_longitude,
-                                      tok_longitudeHemi.p[0]);
-        nmea_reader_update_altitude(r, tok_altitude, tok_altitudeUnits);
-
-    } else if ( !memcmp(tok.p, "GSA", 3) ) {
-        // do something ?
-    } else if ( !memcmp(tok.p, "RMC", 3) ) {
-        Token  tok_time          = nmea_tokenizer_get(tzer,1);
-        Token  tok_fixStatus     = nmea_tokenizer_get(tzer,2);
-        Token  tok_latitude      = nmea_tokenizer_get(tzer,3);
-        Token  tok_latitudeHemi  = nmea_tokenizer_get(tzer,4);
-        Token  tok_longitude     = nmea_tokenizer_get(tzer,5);
-        Token  tok_longitudeHemi = nmea_tokenizer_get(tzer,6);
-        Token  tok_speed         = nmea_tokenizer_get(tzer,7);
-        Token  tok_bearing       = nmea_tokenizer_get(tzer,8);
-        Token  tok_date          = nmea_tokenizer_get(tzer,9);
-
-        D("in RMC, fixStatus=%c", tok_fixStatus.p[0]);
-        if (tok_fixStatus.p[0] == 'A')
-        {
-            nmea_reader_update_date( r, tok_date, tok_time );
-
-            nmea_reader_update_latlong( r, tok_latitude,
-                                           tok_latitudeHemi.p[0],
-                                           tok_longitude,
-                                           tok_longitudeHemi.p[0] );
-
-            nmea_reader_update_bearing( r, tok_bearing );
-            nmea_reader_update_speed  ( r, tok_speed );
-        }
-    } else {
-        tok.p -= 2;
-        D("unknown sentence '%.*s", tok.end-tok.p, tok.p);
+static int
+gps_queue_start( GpsQueue*  q, const GpsCallbacks*  callbacks )
+{
+    memset( q, 0, sizeof(*q) );
+    q->callbacks = callbacks;
+    q->wake[0]   = q->wake[1] = -1;
+
+    if (pipe( q->wake ) < 0) {
+        LOGE("could not create dispatch pipe: %s", strerror(errno));
+        q->wake[0] = q->wake[1] = -1;
+        return -1;
     }
-    if (r->fix.flags != 0) {
-#if GPS_DEBUG
-        char   temp[256];
-        char*  p   = temp;
-        char*  end = p + sizeof(temp);
-        struct tm   utc;
+    fcntl( q->wake[1], F_SETFL, fcntl(q->wake[1], F_GETFL) | O_NONBLOCK );
 
-        p += snprintf( p, end-p, "sending fix" );
-        if (r->fix.flags & GPS_LOCATION_HAS_LAT_LONG) {
-            p += snprintf(p, end-p, " lat=%g lon=%g", r->fix.latitude, r->fix.longitude);
-        }
-        if (r->fix.flags & GPS_LOCATION_HAS_ALTITUDE) {
-            p += snprintf(p, end-p, " altitude=%g", r->fix.altitude);
-        }
-        if (r->fix.flags & GPS_LOCATION_HAS_SPEED) {
-            p += snprintf(p, end-p, " speed=%g", r->fix.speed);
-        }
-        if (r->fix.flags & GPS_LOCATION_HAS_BEARING) {
-            p += snprintf(p, end-p, " bearing=%g", r->fix.bearing);
-        }
-        if (r->fix.flags & GPS_LOCATION_HAS_ACCURACY) {
-            p += snprintf(p,end-p, " accuracy=%g", r->fix.accuracy);
-        }
-        gmtime_r( (time_t*) &r->fix.timestamp, &utc );
-        p += snprintf(p, end-p, " time=%s", asctime( &utc ) );
-        D(temp);
-#endif
-        if (r->callback) {
-            r->callback( &r->fix );
-            r->fix.flags = 0;
-        }
-        else {
-            D("no callback, keeping data until needed !");
-        }
+    if (pthread_create( &q->thread, NULL, gps_queue_thread, q ) != 0) {
+        LOGE("could not create gps dispatch thread: %s", strerror(errno));
+        close( q->wake[0] ); q->wake[0] = -1;
+        close( q->wake[1] ); q->wake[1] = -1;
+        return -1;
     }
+    return 0;
 }
 
 
+/* only once the gps thread is gone, nothing must push any more */
 static void
-nmea_reader_addc( NmeaReader*  r, int  c )
+gps_queue_stop( GpsQueue*  q )
 {
-    if (r->overflow) {
-        r->overflow = (c != '\n');
-        return;
-    }
+    void*  dummy;
 
-    if (r->pos >= (int) sizeof(r->in)-1 ) {
-        r->overflow = 1;
-        r->pos      = 0;
+    if (q->wake[1] < 0)
         return;
-    }
 
-    r->in[r->pos] = (char)c;
-    r->pos       += 1;
+    close( q->wake[1] ); q->wake[1] = -1;
+    pthread_join( q->thread, &dummy );
+    close( q->wake[0] ); q->wake[0] = -1;
+}
+
 
-    if (c == '\n') {
-        nmea_reader_parse( r );
-        r->pos = 0;
-    }
+static void
+gps_queue_location_cb( GpsLocation*  location )
+{
+    gps_queue_push( _gps_queue, GPS_QUEUE_LOCATION, location, sizeof(*location) );
+}
+
+static void
+gps_queue_sv_status_cb( GpsSvStatus*  sv )
+{
+    gps_queue_push( _gps_queue, GPS_QUEUE_SV_STATUS, sv, sizeof(*sv) );
 }
 
+/* what the reader is given instead of the framework callbacks */
+static const GpsCallbacks  gps_queue_callbacks = {
+    sizeof(GpsCallbacks),
+    gps_queue_location_cb,
+    NULL,
+    gps_queue_sv_status_cb,
+    NULL,
+};
+
 
 /*****************************************************************/
 /*****************************************************************/
@@ -562,7 +2424,10 @@ nmea_reader_addc( NmeaReader*  r, int  c )
 enum {
     CMD_QUIT  = 0,
     CMD_START = 1,
-    CMD_STOP  = 2
+    CMD_STOP  = 2,
+    CMD_MODE  = 3,
+    CMD_BATCH = 4,
+    CMD_FLUSH = 5
 };
 
 
@@ -572,7 +2437,15 @@ typedef struct {
     int                     fd;
     GpsCallbacks            callbacks;
     pthread_t               thread;
+    int                     started;        /* thread runs, the dispatch queue too */
     int                     control[2];
+    GpsRecord               record;
+    GpsReplay               replay;
+    int                     uart;           /* fd is a receiver we can write to */
+    int                     fix_interval;   /* ms, 0 for every fix */
+    GpsBatchingCallbacks    batch_callbacks;
+    int                     batch_latency;  /* ms, 0 when not batching */
+    GpsBatch                batch;          /* owned by the gps thread */
 } GpsState;
 
 static GpsState  _gps_state[1];
@@ -581,18 +2454,32 @@ static GpsState  _gps_state[1];
 static void
 gps_state_done( GpsState*  s )
 {
-    // tell the thread to quit, and wait for it
+    // tell the thread to quit, and wait for it. a failed init may have
+    // stopped at any step, only what was set up is torn down
     char   cmd = CMD_QUIT;
     void*  dummy;
-    write( s->control[0], &cmd, 1 );
-    pthread_join(s->thread, &dummy);
+    if (s->started) {
+        write( s->control[0], &cmd, 1 );
+        pthread_join(s->thread, &dummy);
+        s->started = 0;
+    }
+    gps_queue_stop( _gps_queue );
 
     // close the control socket pair
-    close( s->control[0] ); s->control[0] = -1;
-    close( s->control[1] ); s->control[1] = -1;
+    if (s->control[0] >= 0) {
+        close( s->control[0] ); s->control[0] = -1;
+        close( s->control[1] ); s->control[1] = -1;
+    }
 
     // close connection to the QEMU GPS daemon
-    close( s->fd ); s->fd = -1;
+    if (s->fd >= 0) {
+        close( s->fd ); s->fd = -1;
+    }
+    gps_replay_stop( &s->replay );
+    gps_record_close( &s->record );
+    s->batch_latency = 0;
+    s->batch.latency = 0;
+    s->batch.count   = 0;
     s->init = 0;
 }
 
@@ -612,6 +2499,25 @@ gps_state_start( GpsState*  s )
 }
 
 
+/* CMD_MODE, CMD_BATCH and CMD_FLUSH, the thread reads the new settings
+ * from the state */
+static int
+gps_state_send( GpsState*  s, char  cmd )
+{
+    int   ret;
+
+    do { ret=write( s->control[0], &cmd, 1 ); }
+    while (ret < 0 && errno == EINTR);
+
+    if (ret != 1) {
+        D("%s: could not send command %d: ret=%d: %s",
+          __FUNCTION__, cmd, ret, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+
 static void
 gps_state_stop( GpsState*  s )
 {
@@ -627,6 +2533,39 @@ gps_state_stop( GpsState*  s )
 }
 
 
+/* the stats go to the log, and are appended to the file named by
+ * debug.gps.stats. a recording replayed at speed 0 then measures the
+ * parser, runs of different builds can be compared line by line */
+static void
+gps_log_stats( NmeaReader*  r )
+{
+    char  line[512];
+    char  path[PROPERTY_VALUE_MAX];
+    int   len, fd;
+
+    len = nmea_reader_format_stats( r, line, sizeof(line) - 1 );
+    if (len < (int)sizeof(line) - 1)
+        len += snprintf( line + len, sizeof(line) - 1 - len,
+                         " queue_max_depth=%u queue_dropped=%u",
+                         _gps_queue->max_depth, _gps_queue->dropped );
+    if (len > (int)sizeof(line) - 2)
+        len = sizeof(line) - 2;
+    LOGI("gps stats: %s", line);
+
+    if (property_get("debug.gps.stats", path, "") <= 0)
+        return;
+
+    fd = open( path, O_WRONLY | O_CREAT | O_APPEND, 0644 );
+    if (fd < 0) {
+        LOGE("could not open gps stats file %s: %s", path, strerror(errno));
+        return;
+    }
+    line[len++] = '\n';
+    write( fd, line, len );
+    close( fd );
+}
+
+
 static int
 epoll_register( int  epoll_fd, int  fd )
 {
@@ -669,8 +2608,13 @@ gps_state_thread( void*  arg )
     int         started    = 0;
     int         gps_fd     = state->fd;
     int         control_fd = state->control[1];
+    long long   fix_due    = 0;
+    int         ubx_rate   = 0;     /* rate we set on the receiver, 0 if its own */
+    int         ubx_native = 1000;
 
     nmea_reader_init( reader );
+    reader->batch = &state->batch;
+    reader->nochecksum = gps_conf_flag( "ro.kernel.android.gps.nochecksum", "GPS_NO_CHECKSUM" );
 
     // register control file descriptors for polling
     epoll_register( epoll_fd, control_fd );
@@ -681,17 +2625,50 @@ gps_state_thread( void*  arg )
     // now loop
     for (;;) {
         struct epoll_event   events[2];
-        int                  ne, nevents;
+        int                  ne, nevents, timeout = -1;
+        GpsBatch*            batch = &state->batch;
+
+        // a fix missing part of its epoch, and the satellites, still go out after a while
+        if (nmea_reader_epoch_pending( reader )) {
+            long long  left = fix_due - gps_monotonic_us();
+            timeout = left > 0 ? (int)((left + 999) / 1000) : 0;
+        }
+
+        // a batch goes out at the latest latency after its first fix
+        if (batch->count > 0) {
+            long long  now = gps_monotonic_us();
+            int        wait;
+
+            if (batch->due == 0)
+                batch->due = now + batch->latency * 1000LL;
+            if (now >= batch->due)
+                gps_batch_flush( batch );
+            else {
+                wait = (int)((batch->due - now + 999) / 1000);
+                if (timeout < 0 || wait < timeout)
+                    timeout = wait;
+            }
+        }
 
-        nevents = epoll_wait( epoll_fd, events, 2, -1 );
+        nevents = epoll_wait( epoll_fd, events, 2, timeout );
         if (nevents < 0) {
             if (errno != EINTR)
                 LOGE("epoll_wait() unexpected error: %s", strerror(errno));
             continue;
         }
+        if (nevents == 0) {
+            if (nmea_reader_epoch_pending( reader ) &&
+                    gps_monotonic_us() >= fix_due) {
+                D("epoch timed out, sending what it had");
+                nmea_reader_epoch_timeout( reader );
+            }
+            continue;
+        }
         D("gps thread received %d events", nevents);
         for (ne = 0; ne < nevents; ne++) {
-            if ((events[ne].events & (EPOLLERR|EPOLLHUP)) != 0) {
+            // data left before a hangup is read first, a replay ends that way
+            if ((events[ne].events & (EPOLLERR|EPOLLHUP)) != 0 &&
+                (events[ne].events & EPOLLIN) == 0) {
                 LOGE("EPOLLERR or EPOLLHUP after epoll_wait() !?");
                 goto Exit;
             }
@@ -715,35 +2692,76 @@ gps_state_thread( void*  arg )
                         if (!started) {
                             D("gps thread starting  location_cb=%p", state->callbacks.location_cb);
                             started = 1;
-                            nmea_reader_set_callback( reader, state->callbacks.location_cb );
+                            nmea_reader_set_callback( reader, &gps_queue_callbacks );
                         }
                     }
                     else if (cmd == CMD_STOP) {
                         if (started) {
                             D("gps thread stopping");
+                            gps_batch_flush( &state->batch );
+                            gps_log_stats( reader );
                             started = 0;
                             nmea_reader_set_callback( reader, NULL );
                         }
                     }
+                    else if (cmd == CMD_MODE) {
+                        D("gps thread fix interval %d ms", state->fix_interval);
+                        nmea_reader_set_interval( reader, state->fix_interval );
+                    }
+                    else if (cmd == CMD_BATCH) {
+                        D("gps thread batch latency %d ms", state->batch_latency);
+                        gps_batch_set( &state->batch, state->batch_latency,
+                                       state->batch_callbacks.batch_cb );
+                    }
+                    else if (cmd == CMD_FLUSH) {
+                        gps_batch_flush( &state->batch );
+                    }
                 }
                 else if (fd == gps_fd)
                 {
-                    char  buff[32];
                     D("gps fd event");
                     for (;;) {
-                        int  nn, ret;
+                        char*      buff = reader->in + reader->pos;
+                        int        ret;
+                        long long  t0;
 
-                        ret = read( fd, buff, sizeof(buff) );
+                        ret = read( fd, buff, sizeof(reader->in) - reader->pos );
                         if (ret < 0) {
                             if (errno == EINTR)
                                 continue;
                             if (errno != EWOULDBLOCK)
-                                LOGE("error while reading from gps daemon socket: %s:", strerror(errno));
+                                LOGE("error while reading from gps device: %s:", strerror(errno));
                             break;
                         }
+                        if (ret == 0) {
+                            D("gps device closed");
+                            goto Exit;
+                        }
                         D("received %d bytes: %.*s", ret, ret, buff);
-                        for (nn = 0; nn < ret; nn++)
-                            nmea_reader_addc( reader, buff[nn] );
+                        if (state->record.fd >= 0)
+                            gps_record_write( &state->record, buff, ret );
+
+                        t0 = gps_monotonic_us();
+                        nmea_reader_scan( reader, ret );
+                        reader->scan_us += gps_monotonic_us() - t0;
+                        fix_due = t0 + NMEA_EPOCH_TIMEOUT_MS * 1000;
+                    }
+
+                    /* a u-blox receiver can compute fewer solutions itself.
+                     * the rate it had before is put back when fixes are
+                     * wanted at every epoch again */
+                    if (reader->ubx_active && state->uart) {
+                        int  want = reader->fix_interval;
+
+                        if (want > 0 && ubx_rate == 0)
+                            ubx_native = reader->ubx_period > 0 ? reader->ubx_period : 1000;
+                        if (want == 0 && ubx_rate != 0) {
+                            if (ubx_send_rate( fd, ubx_native ) == 0)
+                                ubx_rate = 0;
+                        } else if (want > 0 && want != ubx_rate) {
+                            if (ubx_send_rate( fd, want ) == 0)
+                                ubx_rate = want;
+                        }
                     }
                     D("gps fd event end");
                 }
@@ -755,6 +2773,8 @@ gps_state_thread( void*  arg )
         }
     }
 Exit:
+    gps_log_stats( reader );
+    close( epoll_fd );
     return NULL;
 }
 
@@ -763,18 +2783,36 @@ static void
 gps_state_init( GpsState*  state )
 {
     state->init       = 1;
+    state->started    = 0;
     state->control[0] = -1;
     state->control[1] = -1;
     state->fd         = -1;
+    state->uart       = 0;
+    state->record.fd  = -1;
+    _gps_queue->wake[0] = _gps_queue->wake[1] = -1;
 
-    state->fd = qemud_channel_open(QEMU_CHANNEL_NAME);
+    state->fd = gps_replay_start( &state->replay );
 
     if (state->fd < 0) {
-        D("no gps emulation detected");
-        return;
+        state->fd   = gps_uart_open();
+        state->uart = (state->fd >= 0);
+    }
+
+    if (state->fd < 0) {
+        state->fd = qemud_channel_open(QEMU_CHANNEL_NAME);
+
+        if (state->fd < 0) {
+            D("no gps emulation detected");
+            return;
+        }
+
+        D("gps emulation will read from '%s' qemud channel", QEMU_CHANNEL_NAME );
     }
 
-    D("gps emulation will read from '%s' qemud channel", QEMU_CHANNEL_NAME );
+    gps_record_open( &state->record );
+
+    if ( gps_queue_start( _gps_queue, &state->callbacks ) < 0 )
+        goto Fail;
 
     if ( socketpair( AF_LOCAL, SOCK_STREAM, 0, state->control ) < 0 ) {
         LOGE("could not create thread control socket pair: %s", strerror(errno));
@@ -785,6 +2823,7 @@ gps_state_init( GpsState*  state )
         LOGE("could not create gps thread: %s", strerror(errno));
         goto Fail;
     }
+    state->started = 1;
 
     D("gps state initialized");
     return;
@@ -878,16 +2917,83 @@ qemu_gps_delete_aiding_data(GpsAidingData flags)
 {
 }
 
+/* fix_frequency is the time between fixes in seconds. only standalone
+ * operation is supported, so mode is ignored */
 static int qemu_gps_set_position_mode(GpsPositionMode mode, int fix_frequency)
 {
-    // FIXME - support fix_frequency
+    GpsState*  s = _gps_state;
+
+    if (!s->init) {
+        D("%s: called with uninitialized state !!", __FUNCTION__);
+        return -1;
+    }
+
+    s->fix_interval = fix_frequency > 0 ? fix_frequency * 1000 : 0;
+    D("%s: fix interval %d ms", __FUNCTION__, s->fix_interval);
+    gps_state_send(s, CMD_MODE);
+    return 0;
+}
+
+static int
+qemu_gps_batching_init(GpsBatchingCallbacks* callbacks)
+{
+    GpsState*  s = _gps_state;
+
+    s->batch_callbacks = *callbacks;
     return 0;
 }
 
+static int
+qemu_gps_batching_start(int max_latency_ms)
+{
+    GpsState*  s = _gps_state;
+
+    if (!s->init || s->batch_callbacks.batch_cb == NULL || max_latency_ms <= 0) {
+        D("%s: not initialized or bad latency %d", __FUNCTION__, max_latency_ms);
+        return -1;
+    }
+
+    s->batch_latency = max_latency_ms;
+    return gps_state_send(s, CMD_BATCH);
+}
+
+static int
+qemu_gps_batching_flush(void)
+{
+    GpsState*  s = _gps_state;
+
+    if (!s->init)
+        return -1;
+
+    return gps_state_send(s, CMD_FLUSH);
+}
+
+static int
+qemu_gps_batching_stop(void)
+{
+    GpsState*  s = _gps_state;
+
+    if (!s->init)
+        return -1;
+
+    s->batch_latency = 0;
+    return gps_state_send(s, CMD_BATCH);
+}
+
+static const GpsBatchingInterface  qemuGpsBatchingInterface = {
+    sizeof(GpsBatchingInterface),
+    qemu_gps_batching_init,
+    qemu_gps_batching_start,
+    qemu_gps_batching_flush,
+    qemu_gps_batching_stop,
+};
+
 static const void*
 qemu_gps_get_extension(const char* name)
 {
-    // no extensions supported
+    if (!strcmp(name, GPS_BATCHING_INTERFACE))
+        return &qemuGpsBatchingInterface;
+
     return NULL;
 }
 
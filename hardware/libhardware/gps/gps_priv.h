@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GPS_PRIV_H_
+#define GPS_PRIV_H_
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <hardware/gps.h>
+
+__BEGIN_DECLS
+
+/*****************************************************************************/
+
+/* name passed to get_extension() for the GpsBatchingInterface */
+#define GPS_BATCHING_INTERFACE      "sun4i-gps-batching"
+
+/* most locations a batch holds, and so passed to one batch_cb call */
+#define GPS_BATCH_MAX_LOCATIONS     256
+
+/*
+ * Delivers the locations of a batch, oldest first. Called on the gps thread,
+ * the array is only valid during the call.
+ */
+typedef void (*gps_batch_callback)(GpsLocation *locations, int count);
+
+typedef struct {
+    size_t size;
+    gps_batch_callback batch_cb;
+} GpsBatchingCallbacks;
+
+/*
+ * While batching, the fixes that would go to location_cb are kept in the HAL
+ * and handed over in bulk: when the buffer is full, max_latency_ms after the
+ * oldest fix kept, or on flush(). No fix is dropped. Positions are kept to
+ * 1e-7 degree, altitude to 1cm, speed to 1cm/s, bearing to 0.01 degree and
+ * accuracy to 10cm.
+ *
+ * start() can be called again to change the latency, stop() delivers what is
+ * left and goes back to location_cb. All return 0, or -1 on error.
+ */
+typedef struct {
+    size_t size;
+    int (*init)(GpsBatchingCallbacks *callbacks);
+    int (*start)(int max_latency_ms);
+    int (*flush)(void);
+    int (*stop)(void);
+} GpsBatchingInterface;
+
+/*****************************************************************************/
+
+__END_DECLS
+
+#endif /* GPS_PRIV_H_ */
@@ -0,0 +1,50 @@
+# Copyright (C) 2010 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+
+LOCAL_PATH := $(call my-dir)
+
+# host harnesses of the nmea/ubx parser of gps.c, include/ stands in for the
+# cutils and qemud headers. the Makefile next to this builds them outside the
+# tree, runs corpus/ against regress.expected and has the libFuzzer target
+
+# gps_bench [-n epochs] [-r rounds] [-o report]
+include $(CLEAR_VARS)
+LOCAL_MODULE := gps_bench
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := gps_bench.c
+LOCAL_CFLAGS := -Werror=override-init
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/include hardware/libhardware/include
+LOCAL_LDLIBS := -lpthread -lm -lrt
+include $(BUILD_HOST_EXECUTABLE)
+
+# gps_regress corpus/*, the fuzz target with a main() that replays files
+include $(CLEAR_VARS)
+LOCAL_MODULE := gps_regress
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := gps_fuzz.c
+LOCAL_CFLAGS := -DGPS_FUZZ_MAIN -Werror=override-init
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/include hardware/libhardware/include
+LOCAL_LDLIBS := -lpthread -lm -lrt
+include $(BUILD_HOST_EXECUTABLE)
+
+# gps_numbers [-n fields] [-s seed], str2float and convert_from_hhmm against strtod
+include $(CLEAR_VARS)
+LOCAL_MODULE := gps_numbers
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := gps_numbers.c
+LOCAL_CFLAGS := -Werror=override-init
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/include hardware/libhardware/include
+LOCAL_LDLIBS := -lpthread -lm -lrt
+include $(BUILD_HOST_EXECUTABLE)
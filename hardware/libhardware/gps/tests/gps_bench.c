@@ -0,0 +1,308 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* parser benchmark: feeds generated GGA, RMC and GSV streams, and u-blox
+ * NAV-PVT and NAV-SAT frames, to the NMEA reader and writes one line of key=value pairs per mix, the parser's own
+ * stats line included, so runs can be compared by scripts.
+ *
+ *   gps_bench [-n epochs] [-r rounds] [-o report]
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gps_test.h"
+
+#define  BENCH_EPOCHS   20000
+#define  BENCH_ROUNDS   5
+#define  BENCH_CHUNK    512     /* bytes per read of a serial receiver */
+
+enum {
+    SENT_GGA = 1 << 0,
+    SENT_RMC = 1 << 1,
+    SENT_GSA = 1 << 2,
+    SENT_GSV = 1 << 3,
+    SENT_UBX = 1 << 4       /* NAV-PVT and NAV-SAT instead of sentences */
+};
+
+static const struct {
+    const char*  name;
+    int          sentences;
+} bench_mixes[] = {
+    { "gga",            SENT_GGA },
+    { "rmc",            SENT_RMC },
+    { "gga_rmc",        SENT_GGA | SENT_RMC },
+    { "gga_rmc_gsv",    SENT_GGA | SENT_RMC | SENT_GSV },
+    { "full",           SENT_GGA | SENT_RMC | SENT_GSA | SENT_GSV },
+    { "ubx",            SENT_UBX },
+};
+
+typedef struct {
+    char*   data;
+    size_t  len;
+    size_t  size;
+    int     sentences;
+} BenchStream;
+
+static long  bench_fixes;
+static long  bench_svs;
+
+static void
+bench_location_cb( GpsLocation*  loc )
+{
+    (void)loc;
+    bench_fixes++;
+}
+
+static void
+bench_sv_status_cb( GpsSvStatus*  sv )
+{
+    (void)sv;
+    bench_svs++;
+}
+
+/* room for len more bytes */
+static void
+bench_reserve( BenchStream*  s, size_t  len )
+{
+    while (s->len + len > s->size) {
+        s->size = s->size ? s->size * 2 : 1 << 16;
+        s->data = realloc(s->data, s->size);
+        if (s->data == NULL) {
+            perror("gps_bench");
+            exit(1);
+        }
+    }
+}
+
+/* appends "$<body>*hh\r\n" */
+static void
+bench_put( BenchStream*  s, const char*  fmt, ... )
+{
+    char     body[ NMEA_MAX_SIZE + 1 ];
+    va_list  args;
+    int      len, sum = 0, i;
+
+    va_start(args, fmt);
+    len = vsnprintf(body, sizeof(body), fmt, args);
+    va_end(args);
+
+    for (i = 0; i < len; i++)
+        sum ^= (unsigned char)body[i];
+
+    bench_reserve(s, len + 8);
+    s->len += sprintf(s->data + s->len, "$%s*%02X\r\n", body, sum);
+    s->sentences++;
+}
+
+static void
+bench_le( unsigned char*  p, uint32_t  v, int  size )
+{
+    while (size-- > 0) {
+        *p++ = v & 0xff;
+        v  >>= 8;
+    }
+}
+
+/* appends a NAV frame, sync, class, id, length, payload and checksum */
+static void
+bench_put_ubx( BenchStream*  s, int  id, const unsigned char*  payload, int  len )
+{
+    unsigned char*  f;
+    int             ck_a = 0, ck_b = 0, i;
+
+    bench_reserve(s, len + 8);
+    f = (unsigned char*)s->data + s->len;
+    f[0] = UBX_SYNC1;
+    f[1] = UBX_SYNC2;
+    f[2] = UBX_CLASS_NAV;
+    f[3] = id;
+    bench_le(f + 4, len, 2);
+    memcpy(f + 6, payload, len);
+    for (i = 2; i < len + 6; i++) {
+        ck_a += f[i];
+        ck_b += ck_a;
+    }
+    f[len + 6] = ck_a & 0xff;
+    f[len + 7] = ck_b & 0xff;
+    s->len += len + 8;
+    s->sentences++;
+}
+
+/* the epoch of bench_generate as a receiver in ubx mode sends it: a 3d fix
+ * and twelve satellites, eight of them used */
+static void
+bench_put_ubx_epoch( BenchStream*  s, int  n, int  t, double  lat, double  lon )
+{
+    unsigned char  pvt[92], sat[8 + 12*12];
+    int            k;
+
+    memset(pvt, 0, sizeof(pvt));
+    bench_le(pvt + 0, n * 1000, 4);                     // iTOW
+    bench_le(pvt + 4, 1994, 2);
+    pvt[6]  = 3;
+    pvt[7]  = 23;
+    pvt[8]  = t / 3600;
+    pvt[9]  = t / 60 % 60;
+    pvt[10] = t % 60;
+    pvt[11] = 0x07;                                     // date and time valid, resolved
+    pvt[20] = 3;                                        // 3d
+    pvt[21] = 0x01;                                     // gnss fix ok
+    bench_le(pvt + 24, (uint32_t)(int32_t)((11 + lon / 60) * 1e7), 4);
+    bench_le(pvt + 28, (uint32_t)(int32_t)((48 + lat / 60) * 1e7), 4);
+    bench_le(pvt + 36, 545400 + (n % 50) * 100, 4);     // hMSL, mm
+    bench_le(pvt + 40, 2500, 4);                        // hAcc, mm
+    bench_le(pvt + 60, 11520, 4);                       // gSpeed, mm/s
+    bench_le(pvt + 64, 8440000, 4);                     // headMot, 1e-5 deg
+    bench_put_ubx(s, UBX_NAV_PVT, pvt, sizeof(pvt));
+
+    memset(sat, 0, sizeof(sat));
+    bench_le(sat + 0, n * 1000, 4);
+    sat[4] = 1;
+    sat[5] = 12;
+    for (k = 0; k < 12; k++) {
+        unsigned char*  q = sat + 8 + 12*k;
+
+        q[1] = k + 1;
+        q[2] = 25 + k;
+        q[3] = 10 + 5*k;
+        bench_le(q + 4, (n + 30*k) % 360, 2);
+        if (k < 8)
+            q[8] = 0x08;                                // used in the fix
+    }
+    bench_put_ubx(s, UBX_NAV_SAT, sat, sizeof(sat));
+}
+
+static void
+bench_generate( BenchStream*  s, int  mix, int  epochs )
+{
+    int  n, k;
+
+    for (n = 0; n < epochs; n++) {
+        int     t   = n % 86400;
+        int     hh  = t / 3600, mm = t / 60 % 60, ss = t % 60;
+        double  lat = 7.038 + (n % 1000) * 0.0001;
+        double  lon = 31.000 + (n % 700) * 0.0001;
+
+        if (mix & SENT_UBX) {
+            bench_put_ubx_epoch(s, n, t, lat, lon);
+            continue;
+        }
+        if (mix & SENT_RMC)
+            bench_put(s, "GPRMC,%02d%02d%02d.00,A,48%07.4f,N,011%07.4f,E,022.4,084.4,230394,003.1,W,A",
+                      hh, mm, ss, lat, lon);
+        if (mix & SENT_GGA)
+            bench_put(s, "GPGGA,%02d%02d%02d.00,48%07.4f,N,011%07.4f,E,1,12,0.9,%.1f,M,46.9,M,,",
+                      hh, mm, ss, lat, lon, 545.4 + (n % 50) * 0.1);
+        if (mix & SENT_GSA)
+            bench_put(s, "GPGSA,A,3,01,02,03,04,05,06,07,08,09,10,11,12,1.8,0.9,1.5");
+        if (mix & SENT_GSV) {
+            for (k = 0; k < 3; k++)
+                bench_put(s, "GPGSV,3,%d,12,%02d,%02d,%03d,%02d,%02d,%02d,%03d,%02d,"
+                             "%02d,%02d,%03d,%02d,%02d,%02d,%03d,%02d",
+                          k + 1,
+                          k * 4 + 1, 10 + k, (n + 30 * k) % 360, 40 + k,
+                          k * 4 + 2, 20 + k, (n + 30 * k + 90) % 360, 35 + k,
+                          k * 4 + 3, 30 + k, (n + 30 * k + 180) % 360, 30 + k,
+                          k * 4 + 4, 40 + k, (n + 30 * k + 270) % 360, 25 + k);
+        }
+    }
+}
+
+static long long
+bench_now_us( void )
+{
+    struct timespec  ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int
+main( int  argc, char**  argv )
+{
+    static NmeaReader  reader[1];
+    GpsCallbacks       callbacks;
+    const char*        report = NULL;
+    FILE*              out = stdout;
+    int                epochs = BENCH_EPOCHS, rounds = BENCH_ROUNDS;
+    int                opt;
+    unsigned           m;
+
+    while ((opt = getopt(argc, argv, "n:r:o:")) != -1) {
+        switch (opt) {
+        case 'n': epochs = atoi(optarg); break;
+        case 'r': rounds = atoi(optarg); break;
+        case 'o': report = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-n epochs] [-r rounds] [-o report]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (epochs <= 0 || rounds <= 0) {
+        fprintf(stderr, "%s: epochs and rounds must be positive\n", argv[0]);
+        return 2;
+    }
+    if (report != NULL && (out = fopen(report, "w")) == NULL) {
+        perror(report);
+        return 1;
+    }
+
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.size         = sizeof(callbacks);
+    callbacks.location_cb  = bench_location_cb;
+    callbacks.sv_status_cb = bench_sv_status_cb;
+
+    for (m = 0; m < sizeof(bench_mixes) / sizeof(bench_mixes[0]); m++) {
+        BenchStream  s;
+        char         stats[512];
+        long long    best = -1;
+        int          round;
+
+        memset(&s, 0, sizeof(s));
+        bench_generate(&s, bench_mixes[m].sentences, epochs);
+
+        for (round = 0; round < rounds; round++) {
+            long long  start, spent;
+
+            nmea_reader_init(reader);
+            nmea_reader_set_callback(reader, &callbacks);
+            bench_fixes = bench_svs = 0;
+
+            start = bench_now_us();
+            gps_test_feed(reader, (const unsigned char*)s.data, s.len, BENCH_CHUNK);
+            nmea_reader_epoch_timeout(reader);
+            spent = bench_now_us() - start;
+            if (best < 0 || spent < best)
+                best = spent;
+        }
+
+        // the gps thread times its reads into scan_us, here the best round is
+        reader->scan_us = best;
+        nmea_reader_format_stats(reader, stats, sizeof(stats));
+        fprintf(out, "mix=%s bytes=%lu ns_per_sentence=%lld fixes=%ld sv_reports=%ld %s\n",
+                bench_mixes[m].name, (unsigned long)s.len, best * 1000 / s.sentences,
+                bench_fixes, bench_svs, stats);
+        free(s.data);
+    }
+
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* fuzz target for the receiver stream parser: NMEA sentences and UBX frames,
+ * alone or mixed, with the checks the gps thread does on the way.
+ *
+ * built with -fsanitize=fuzzer the libFuzzer entry point below is all there
+ * is. otherwise GPS_FUZZ_MAIN adds a main() that runs each file named on the
+ * command line through it once and prints every fix decoded, then the
+ * counters of the parser, which is how the inputs in corpus/ are kept as
+ * regression tests.
+ */
+
+#include <stdio.h>
+
+#include "gps_test.h"
+
+static long  fuzz_fixes;
+static long  fuzz_svs;
+static long  fuzz_batched;
+static int   fuzz_print;        /* print the fixes, not while fuzzing */
+
+/* one line per fix with what the framework would get out of it */
+static void
+fuzz_print_fix( const char*  how, const GpsLocation*  loc )
+{
+    if (!fuzz_print)
+        return;
+    printf("  %s flags=0x%02x lat=%.9f lon=%.9f alt=%.3f speed=%.3f bearing=%.3f "
+           "accuracy=%.3f time=%lld\n",
+           how, loc->flags, loc->latitude, loc->longitude, loc->altitude,
+           loc->speed, loc->bearing, loc->accuracy, (long long)loc->timestamp);
+}
+
+static void
+fuzz_location_cb( GpsLocation*  loc )
+{
+    if (loc->size != sizeof(*loc))
+        abort();
+    fuzz_print_fix("fix", loc);
+    fuzz_fixes++;
+}
+
+static void
+fuzz_sv_status_cb( GpsSvStatus*  sv )
+{
+    if (sv->num_svs < 0 || sv->num_svs > GPS_MAX_SVS)
+        abort();
+    fuzz_svs++;
+}
+
+static void
+fuzz_batch_cb( GpsLocation*  locations, int  count )
+{
+    int  i;
+
+    if (count <= 0 || count > GPS_BATCH_MAX_LOCATIONS)
+        abort();
+    for (i = 0; i < count; i++)
+        fuzz_print_fix("batched", &locations[i]);
+    fuzz_batched += count;
+}
+
+static NmeaReader  fuzz_reader[1];
+
+/* the whole input in one read with every fix reported, then again in short
+ * reads with one fix a second kept in a batch */
+int
+LLVMFuzzerTestOneInput( const uint8_t*  data, size_t  size )
+{
+    static GpsBatch  batch;
+    GpsCallbacks     callbacks;
+    int              pass;
+
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.size         = sizeof(callbacks);
+    callbacks.location_cb  = fuzz_location_cb;
+    callbacks.sv_status_cb = fuzz_sv_status_cb;
+
+    for (pass = 0; pass < 2; pass++) {
+        memset(&batch, 0, sizeof(batch));
+        nmea_reader_init(fuzz_reader);
+        nmea_reader_set_callback(fuzz_reader, &callbacks);
+        if (pass == 1) {
+            fuzz_reader->batch = &batch;
+            gps_batch_set(&batch, 1000, fuzz_batch_cb);
+            nmea_reader_set_interval(fuzz_reader, 1000);
+        }
+        gps_test_feed(fuzz_reader, data, size, pass == 0 ? NMEA_BUFF_SIZE : 7);
+        // the stream stops, as the gps thread sees it after NMEA_EPOCH_TIMEOUT_MS
+        nmea_reader_epoch_timeout(fuzz_reader);
+        gps_batch_flush(&batch);
+    }
+    return 0;
+}
+
+#ifdef GPS_FUZZ_MAIN
+int
+main( int  argc, char**  argv )
+{
+    int  i;
+
+    fuzz_print = 1;
+    for (i = 1; i < argc; i++) {
+        FILE*           f = fopen(argv[i], "rb");
+        unsigned char*  data;
+        long            size;
+        const char*     name;
+
+        if (f == NULL || fseek(f, 0, SEEK_END) < 0 || (size = ftell(f)) < 0) {
+            perror(argv[i]);
+            return 1;
+        }
+        rewind(f);
+        data = malloc(size ? size : 1);
+        if (data == NULL || fread(data, 1, size, f) != (size_t)size) {
+            perror(argv[i]);
+            return 1;
+        }
+        fclose(f);
+
+        name = strrchr(argv[i], '/') ? strrchr(argv[i], '/') + 1 : argv[i];
+        printf("%s\n", name);
+
+        fuzz_fixes = fuzz_svs = fuzz_batched = 0;
+        LLVMFuzzerTestOneInput(data, size);
+        free(data);
+
+        // fixes come from the first pass, batched and the parser counters from the second
+        printf("%s fixes=%ld sv_reports=%ld batched=%ld sentences=%u bad_checksum=%u "
+               "malformed=%u no_checksum=%u epochs=%u\n",
+               name, fuzz_fixes, fuzz_svs, fuzz_batched, fuzz_reader->accepted,
+               fuzz_reader->rejected, fuzz_reader->malformed, fuzz_reader->unchecked,
+               fuzz_reader->epochs);
+    }
+    return 0;
+}
+#endif
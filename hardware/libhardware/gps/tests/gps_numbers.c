@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* the number parsing of gps.c against strtod: str2float must give the very
+ * double strtod gives, and convert_from_hhmm what strtod gives for the
+ * degrees and minutes read apart. fixed edge cases first, then generated
+ * fields. prints the first mismatches and exits 1 if there is any.
+ *
+ *   gps_numbers [-n fields] [-s seed]
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "gps_test.h"
+
+#define  NUMBERS_FIELDS     1000000
+#define  NUMBERS_REPORTED   10
+
+static const char* const  numbers_fixed[] = {
+    "", "0", "-0", "+0", "-", "+", ".", "-.", "0.", ".0", "1", "-1", "+1",
+    "0.1", "0.2", "0.3", "0.7", "1.5", "9.9", "22.4", "084.4", "545.4",
+    "-17.3", "003.1", "0.9", "99.99", "123456.789", "000000.00",
+    "4807.0380", "01131.0010", "4807.038", "1131.000", "0000.0000",
+    "8959.99999999", "17959.99999999", "9007199254740991",
+    "900719925474099.1", "0.000000000000000001", "1.23456789012345678",
+    "12,5", "3.1*", "7.5.1",
+};
+
+static unsigned long  numbers_seed = 1;
+static int            numbers_failed;
+
+static unsigned
+numbers_rand( void )
+{
+    numbers_seed = numbers_seed * 6364136223846793005UL + 1442695040888963407UL;
+    return (unsigned)(numbers_seed >> 33);
+}
+
+static int
+numbers_same( double  a, double  b )
+{
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+static void
+numbers_fail( const char*  what, const char*  field, double  got, double  want )
+{
+    if (numbers_failed++ < NUMBERS_REPORTED)
+        printf("%s '%s': %.17g, strtod %.17g\n", what, field, got, want);
+}
+
+static double
+numbers_strtod( const char*  p, int  len )
+{
+    char  temp[64];
+
+    memcpy(temp, p, len);
+    temp[len] = 0;
+    return strtod(temp, NULL);
+}
+
+static void
+numbers_check_float( const char*  field )
+{
+    int     len  = strlen(field);
+    double  got  = str2float(field, field + len);
+    double  want = numbers_strtod(field, len);
+
+    if (!numbers_same(got, want))
+        numbers_fail("str2float", field, got, want);
+}
+
+/* [d]ddmm.mmmm: what is left of the last two integer digits are degrees */
+static void
+numbers_check_hhmm( const char*  field )
+{
+    int     len  = strlen(field);
+    int     ints = strspn(field, "0123456789");
+    Token   tok;
+    double  got, want;
+
+    // positions as receivers send them, in the exact path: the fallback for
+    // more digits than a double holds makes no claim
+    if (ints < 3 || ints > 5 || field[ints] != '.' ||
+        strspn(field + ints + 1, "0123456789") != (size_t)(len - ints - 1) || len - 1 > 15)
+        return;
+
+    tok.p   = field;
+    tok.end = field + len;
+    got  = convert_from_hhmm(tok);
+    want = (int)numbers_strtod(field, ints - 2) +
+           numbers_strtod(field + ints - 2, len - ints + 2) / 60.0;
+    if (!numbers_same(got, want))
+        numbers_fail("convert_from_hhmm", field, got, want);
+}
+
+/* digits as receivers print them, [-]int[.frac], sometimes with the next
+ * character of the sentence behind */
+static void
+numbers_generate( char*  field )
+{
+    static const char  after[] = ",*\r";
+    int  ints  = numbers_rand() % 10;
+    int  fracs = numbers_rand() % 11;
+    int  k     = 0;
+
+    if (numbers_rand() % 8 == 0)
+        field[k++] = '-';
+    while (ints-- > 0)
+        field[k++] = '0' + numbers_rand() % 10;
+    if (fracs > 0 || numbers_rand() % 4 == 0) {
+        field[k++] = '.';
+        while (fracs-- > 0)
+            field[k++] = '0' + numbers_rand() % 10;
+    }
+    if (numbers_rand() % 8 == 0)
+        field[k++] = after[numbers_rand() % 3];
+    field[k] = 0;
+}
+
+int
+main( int  argc, char**  argv )
+{
+    long    fields = NUMBERS_FIELDS;
+    char    field[32];
+    size_t  i;
+    long    n;
+    int     opt;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+        case 'n': fields = atol(optarg); break;
+        case 's': numbers_seed = strtoul(optarg, NULL, 0); break;
+        default:
+            fprintf(stderr, "usage: %s [-n fields] [-s seed]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    for (i = 0; i < sizeof(numbers_fixed) / sizeof(numbers_fixed[0]); i++) {
+        numbers_check_float(numbers_fixed[i]);
+        numbers_check_hhmm(numbers_fixed[i]);
+    }
+    for (n = 0; n < fields; n++) {
+        numbers_generate(field);
+        numbers_check_float(field);
+        numbers_check_hhmm(field);
+    }
+
+    printf("numbers=%ld mismatches=%d\n",
+           fields + (long)(sizeof(numbers_fixed) / sizeof(numbers_fixed[0])), numbers_failed);
+    return numbers_failed != 0;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* gps.c built on the host: the harnesses include the HAL itself, so the
+ * parser is driven through its static functions exactly as the gps thread
+ * drives it. include/ holds stand-ins for the cutils and qemud headers. */
+
+#ifndef GPS_TEST_H_
+#define GPS_TEST_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../gps.c"
+
+/* hands len bytes to the reader chunk bytes at a time, as reads would */
+static void
+gps_test_feed( NmeaReader*  r, const unsigned char*  data, size_t  len, int  chunk )
+{
+    size_t  off = 0;
+
+    while (off < len) {
+        int  n = sizeof(r->in) - r->pos;
+
+        if (n > chunk)
+            n = chunk;
+        if ((size_t)n > len - off)
+            n = len - off;
+        memcpy( r->in + r->pos, data + off, n );
+        nmea_reader_scan( r, n );
+        off += n;
+    }
+}
+
+#endif /* GPS_TEST_H_ */
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* host stand-in for cutils/log.h: the harness is quiet unless GPS_TEST_VERBOSE
+ * is set in the environment, a fuzzer feeds it mostly garbage */
+
+#ifndef GPS_TEST_CUTILS_LOG_H_
+#define GPS_TEST_CUTILS_LOG_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define  GPS_TEST_LOG(prio, ...)                                \
+    do {                                                        \
+        if (getenv("GPS_TEST_VERBOSE") != NULL) {               \
+            fprintf(stderr, prio "/" LOG_TAG ": " __VA_ARGS__); \
+            fputc('\n', stderr);                                \
+        }                                                       \
+    } while (0)
+
+#define  LOGV(...)  GPS_TEST_LOG("V", __VA_ARGS__)
+#define  LOGD(...)  GPS_TEST_LOG("D", __VA_ARGS__)
+#define  LOGI(...)  GPS_TEST_LOG("I", __VA_ARGS__)
+#define  LOGW(...)  GPS_TEST_LOG("W", __VA_ARGS__)
+#define  LOGE(...)  GPS_TEST_LOG("E", __VA_ARGS__)
+
+#endif /* GPS_TEST_CUTILS_LOG_H_ */
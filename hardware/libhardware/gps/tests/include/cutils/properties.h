@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* host stand-in for cutils/properties.h: a property is read from the
+ * environment variable of the same name with '.' turned into '_', so
+ * debug_gps_stats=/tmp/stats runs the harness with debug.gps.stats set */
+
+#ifndef GPS_TEST_CUTILS_PROPERTIES_H_
+#define GPS_TEST_CUTILS_PROPERTIES_H_
+
+#include <stdlib.h>
+#include <string.h>
+
+#define  PROPERTY_KEY_MAX    32
+#define  PROPERTY_VALUE_MAX  92
+
+static int
+property_get( const char*  key, char*  value, const char*  default_value )
+{
+    char         name[ PROPERTY_KEY_MAX ];
+    const char*  v;
+    int          i;
+
+    for (i = 0; key[i] && i < PROPERTY_KEY_MAX - 1; i++)
+        name[i] = (key[i] == '.') ? '_' : key[i];
+    name[i] = 0;
+
+    v = getenv(name);
+    if (v == NULL)
+        v = default_value ? default_value : "";
+
+    strncpy(value, v, PROPERTY_VALUE_MAX - 1);
+    value[PROPERTY_VALUE_MAX - 1] = 0;
+    return strlen(value);
+}
+
+static int
+property_set( const char*  key, const char*  value )
+{
+    (void)key;
+    (void)value;
+    return 0;
+}
+
+#endif /* GPS_TEST_CUTILS_PROPERTIES_H_ */
@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* host stand-in for cutils/sockets.h, gps.c only needs the socket calls */
+
+#ifndef GPS_TEST_CUTILS_SOCKETS_H_
+#define GPS_TEST_CUTILS_SOCKETS_H_
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#endif /* GPS_TEST_CUTILS_SOCKETS_H_ */
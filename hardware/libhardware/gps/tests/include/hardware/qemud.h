@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2010 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* host stand-in for hardware/qemud.h: there is no emulator daemon */
+
+#ifndef GPS_TEST_HARDWARE_QEMUD_H_
+#define GPS_TEST_HARDWARE_QEMUD_H_
+
+#include <errno.h>
+
+static int
+qemud_channel_open( const char*  name )
+{
+    (void)name;
+    errno = ENOENT;
+    return -1;
+}
+
+#endif /* GPS_TEST_HARDWARE_QEMUD_H_ */
@@ -25,9 +25,21 @@
 #include <fcntl.h>
 #include <pthread.h>
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
 #include <sys/ioctl.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+
+#include <linux/fb.h>
 
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include <cutils/properties.h>
 #include <hardware/lights.h>
 #include <drv_display_sun4i.h>
 
@@ -40,6 +52,109 @@ static struct light_state_t g_battery;
 static int g_backlight = 14;
 static int g_haveTrackballLight = 0;
 
+/*
+ * Content adaptive backlight: a thread samples the front framebuffer every
+ * CABC_PERIOD_MS and lowers the backlight while the picture is dark, never
+ * below persist.sys.cabc.min percent of the brightness the user set.
+ */
+#define CABC_PERIOD_MS      500
+#define CABC_BUDGET_US      5000    /* cpu time one sample may take */
+#define CABC_MIN_STEP       4       /* finest sampling grid, in 8 pixel runs */
+#define CABC_MAX_STEP       64
+#define CABC_BINS           64
+#define CABC_HEADROOM       16      /* luma kept above the bright end of the picture */
+#define CABC_RAMP           4       /* percent the scale moves per period */
+#define CABC_REPORT_TICKS   120     /* publish the savings once a minute */
+
+struct cabc_state_t
+{
+    pthread_t               thread;
+    int                     running;
+    int                     fb_fd;
+    unsigned char          *fb_base;
+    size_t                  fb_size;
+    int                     min_percent;
+    int                     scale;          /* percent of g_backlight sent to the panel */
+    int                     step;           /* sampled runs are this many runs apart */
+    unsigned long long      saved_ms;       /* full backlight time the dimming is worth */
+    unsigned int            histogram[CABC_BINS];
+};
+
+static struct cabc_state_t g_cabc;
+
+/*
+ * Backlight ramp: set_light_backlight only records the target, a thread moves
+ * the panel toward it RAMP_TICK_MS at a time, evenly in perceived brightness.
+ * Requests that arrive during a ramp just move its end point, and the driver
+ * is not called when the panel value would stay the same.
+ */
+#define RAMP_TICK_MS        16
+#define RAMP_STEP           12      /* perceived levels per tick, full range in ~340ms */
+
+/* ticks are timed on the monotonic clock, a wall clock change must not stall or rush a ramp */
+#if defined(HAVE_PTHREAD_COND_TIMEDWAIT_MONOTONIC)
+#define ramp_timedwait(cond, lock, ts) pthread_cond_timedwait_monotonic(cond, lock, ts)
+#else
+#define ramp_timedwait(cond, lock, ts) pthread_cond_timedwait(cond, lock, ts)
+#endif
+
+struct ramp_state_t
+{
+    pthread_t               thread;
+    pthread_cond_t          cond;
+    int                     running;
+    int                     fd;
+    int                     target;         /* panel brightness to reach, -1 before the first request */
+    int                     level;          /* perceived level the panel is at, -1 before the first request */
+    int                     written;        /* last value sent to the driver, -1 if none */
+    unsigned int            requests;
+    unsigned int            writes;
+};
+
+/* target == written: the panel keeps what the bootloader set until the framework asks */
+static struct ramp_state_t g_ramp = { .target = -1, .level = -1, .written = -1 };
+
+/* perceived level (gamma 2.2) -> panel brightness, and back */
+static const unsigned char g_gamma[256] =
+{
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,
+      1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+      3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+      6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  11,  11,  11,  12,
+     12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,
+     20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+     30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,  41,
+     42,  43,  43,  44,  45,  46,  47,  48,  49,  49,  50,  51,  52,  53,  54,  55,
+     56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+     73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,  87,  88,  89,  90,
+     91,  93,  94,  95,  97,  98,  99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+    113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+    137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+    163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+    192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+    223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255,
+};
+
+static const unsigned char g_degamma[256] =
+{
+      0,  21,  28,  34,  39,  43,  46,  50,  53,  56,  59,  61,  64,  66,  68,  70,
+     72,  74,  76,  78,  80,  82,  84,  85,  87,  89,  90,  92,  93,  95,  96,  98,
+     99, 101, 102, 103, 105, 106, 107, 109, 110, 111, 112, 114, 115, 116, 117, 118,
+    119, 120, 122, 123, 124, 125, 126, 127, 128, 129, 130, 131, 132, 133, 134, 135,
+    136, 137, 138, 139, 140, 141, 142, 143, 144, 144, 145, 146, 147, 148, 149, 150,
+    151, 151, 152, 153, 154, 155, 156, 156, 157, 158, 159, 160, 160, 161, 162, 163,
+    164, 164, 165, 166, 167, 167, 168, 169, 170, 170, 171, 172, 173, 173, 174, 175,
+    175, 176, 177, 178, 178, 179, 180, 180, 181, 182, 182, 183, 184, 184, 185, 186,
+    186, 187, 188, 188, 189, 190, 190, 191, 192, 192, 193, 194, 194, 195, 195, 196,
+    197, 197, 198, 199, 199, 200, 200, 201, 202, 202, 203, 203, 204, 205, 205, 206,
+    206, 207, 207, 208, 209, 209, 210, 210, 211, 212, 212, 213, 213, 214, 214, 215,
+    215, 216, 217, 217, 218, 218, 219, 219, 220, 220, 221, 221, 222, 223, 223, 224,
+    224, 225, 225, 226, 226, 227, 227, 228, 228, 229, 229, 230, 230, 231, 231, 232,
+    232, 233, 233, 234, 234, 235, 235, 236, 236, 237, 237, 238, 238, 239, 239, 240,
+    240, 241, 241, 242, 242, 243, 243, 244, 244, 245, 245, 246, 246, 247, 247, 248,
+    248, 249, 249, 249, 250, 250, 251, 251, 252, 252, 253, 253, 254, 254, 255, 255,
+};
+
 /* Only one instance is created per platform */
 struct light_context_t 
 {
@@ -82,31 +197,393 @@ rgb_to_brightness(struct light_state_t const* state)
     return bright;
 }
 
+/* brightness the panel gets for a user brightness, called with g_lock held */
 static int
-set_light_backlight(struct light_device_t* dev,
-        struct light_state_t const* state)
+cabc_apply_scale(int brightness)
 {
-    struct light_context_t      *ctx;
+    int scaled;
 
-    int err = 0;
+    if (!g_cabc.running || g_cabc.scale >= 100)
+        return brightness;
+
+    scaled = brightness * g_cabc.scale / 100;
+    /* fix bright value >=5 , for HW reason*/
+    return scaled < 5 ? 5 : scaled;
+}
 
+/* point the ramp at the current user brightness and scale, called with g_lock held */
+static void
+ramp_set_target_locked(void)
+{
+    g_ramp.target = cabc_apply_scale(g_backlight);
+    g_ramp.requests++;
+    pthread_cond_signal(&g_ramp.cond);
+}
+
+static void *
+ramp_thread(void *arg)
+{
+    unsigned long args[3];
+    struct timespec ts;
+    int goal, value;
+
+    pthread_mutex_lock(&g_lock);
+    while (g_ramp.running) {
+        if (g_ramp.target == g_ramp.written) {
+            pthread_cond_wait(&g_ramp.cond, &g_lock);
+            continue;
+        }
+
+        goal = g_degamma[g_ramp.target];
+        if (g_ramp.level < 0) {
+            /* nothing known about the panel yet, go straight there */
+            g_ramp.level = goal;
+        } else if (g_ramp.level < goal) {
+            g_ramp.level = (goal - g_ramp.level > RAMP_STEP) ? g_ramp.level + RAMP_STEP : goal;
+        } else if (g_ramp.level > goal) {
+            g_ramp.level = (g_ramp.level - goal > RAMP_STEP) ? g_ramp.level - RAMP_STEP : goal;
+        }
+
+        /* the last step lands exactly on the target, the tables round */
+        value = (g_ramp.level == goal) ? g_ramp.target : g_gamma[g_ramp.level];
+        if (value < 5)
+            value = 5;
+
+        if (value != g_ramp.written) {
+            pthread_mutex_unlock(&g_lock);
+            args[0] = 0;
+            args[1] = value;
+            args[2] = 0;
+            if (ioctl(g_ramp.fd, DISP_CMD_LCD_SET_BRIGHTNESS, args) != 0)
+                LOGE("set backlight %d failed, errno = %d\n", value, errno);
+            pthread_mutex_lock(&g_lock);
+            g_ramp.written = value;
+            g_ramp.writes++;
+        }
+
+        if (g_ramp.level != goal) {
+            /* requests during the tick only move the target, the next step heads for it */
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            ts.tv_nsec += RAMP_TICK_MS * 1000000;
+            if (ts.tv_nsec >= 1000000000) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000;
+            }
+            while (g_ramp.running &&
+                   ramp_timedwait(&g_ramp.cond, &g_lock, &ts) != ETIMEDOUT)
+                ;
+        } else {
+            g_ramp.written = g_ramp.target;
+        }
+    }
+    pthread_mutex_unlock(&g_lock);
+
+    return NULL;
+}
+
+static int
+ramp_start(int fd)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+#if !defined(HAVE_PTHREAD_COND_TIMEDWAIT_MONOTONIC)
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+    pthread_cond_init(&g_ramp.cond, &attr);
+    pthread_condattr_destroy(&attr);
+    g_ramp.fd = fd;
+    g_ramp.running = 1;
+    if (pthread_create(&g_ramp.thread, NULL, ramp_thread, NULL) != 0) {
+        LOGE("can't start backlight thread\n");
+        g_ramp.running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+static void
+ramp_stop(void)
+{
+    if (!g_ramp.running)
+        return;
+
+    pthread_mutex_lock(&g_lock);
+    g_ramp.running = 0;
+    pthread_cond_signal(&g_ramp.cond);
+    pthread_mutex_unlock(&g_lock);
+    pthread_join(g_ramp.thread, NULL);
+
+    LOGD("backlight: %u requests, %u driver writes\n", g_ramp.requests, g_ramp.writes);
+    pthread_cond_destroy(&g_ramp.cond);
+}
+
+static long long
+cabc_thread_time_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* add the luma of n runs of 8 32bpp pixels, runs are stride bytes apart, r/g/b are the bytes of the channels */
+static void
+cabc_histogram_32(const unsigned char *p, int n, int stride, int r, int g, int b, unsigned int *histogram)
+{
+    int i, k;
+#if defined(__ARM_NEON__)
+    uint8_t luma[8];
+    const uint8x8_t kr = vdup_n_u8(77);
+    const uint8x8_t kg = vdup_n_u8(150);
+    const uint8x8_t kb = vdup_n_u8(29);
+
+    for (i = 0; i < n; i++, p += stride) {
+        uint8x8x4_t px = vld4_u8(p);
+        uint16x8_t acc = vmull_u8(px.val[r], kr);
+        acc = vmlal_u8(acc, px.val[g], kg);
+        acc = vmlal_u8(acc, px.val[b], kb);
+        vst1_u8(luma, vshrn_n_u16(acc, 8));
+        for (k = 0; k < 8; k++)
+            histogram[luma[k] >> 2]++;
+    }
+#else
+    for (i = 0; i < n; i++, p += stride) {
+        for (k = 0; k < 8; k++) {
+            const unsigned char *q = p + k * 4;
+            histogram[((77 * q[r] + 150 * q[g] + 29 * q[b]) >> 8) >> 2]++;
+        }
+    }
+#endif
+}
+
+/* same for rgb565 */
+static void
+cabc_histogram_16(const unsigned char *p, int n, int stride, unsigned int *histogram)
+{
+    int i, k;
+
+    for (i = 0; i < n; i++, p += stride) {
+        const uint16_t *q = (const uint16_t *)p;
+        for (k = 0; k < 8; k++) {
+            int r = (q[k] >> 8) & 0xf8;
+            int g = (q[k] >> 3) & 0xfc;
+            int b = (q[k] << 3) & 0xf8;
+            histogram[((77 * r + 150 * g + 29 * b) >> 8) >> 2]++;
+        }
+    }
+}
+
+/* map fb0 once, again if the display HAL reallocated it */
+static int
+cabc_map_fb(struct fb_fix_screeninfo *fix)
+{
+    if (g_cabc.fb_base && g_cabc.fb_size == fix->smem_len)
+        return 0;
+
+    if (g_cabc.fb_base)
+        munmap(g_cabc.fb_base, g_cabc.fb_size);
+
+    g_cabc.fb_size = fix->smem_len;
+    g_cabc.fb_base = mmap(NULL, g_cabc.fb_size, PROT_READ, MAP_SHARED, g_cabc.fb_fd, 0);
+    if (g_cabc.fb_base == MAP_FAILED) {
+        g_cabc.fb_base = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/* luma (0-255) below which 98% of the sampled pixels lie, -1 if the fb can't be read */
+static int
+cabc_sample(void)
+{
+    struct fb_fix_screeninfo fix;
+    struct fb_var_screeninfo var;
+    unsigned int total = 0, seen = 0;
+    const unsigned char *front;
+    int bpp, runs, y, i;
+
+    if (ioctl(g_cabc.fb_fd, FBIOGET_FSCREENINFO, &fix) < 0 ||
+        ioctl(g_cabc.fb_fd, FBIOGET_VSCREENINFO, &var) < 0 ||
+        cabc_map_fb(&fix) < 0)
+        return -1;
+
+    bpp = var.bits_per_pixel >> 3;
+    if ((bpp != 4 && bpp != 2) ||
+        (size_t)(var.yoffset + var.yres) * fix.line_length > g_cabc.fb_size)
+        return -1;
+
+    /* 32bpp channels are whole bytes, which ones depends on the format the fb was set up with */
+    if (bpp == 4 &&
+        (((var.red.offset | var.green.offset | var.blue.offset) & 7) ||
+         var.red.offset > 24 || var.green.offset > 24 || var.blue.offset > 24))
+        return -1;
+
+    memset(g_cabc.histogram, 0, sizeof(g_cabc.histogram));
+    front = g_cabc.fb_base + var.yoffset * fix.line_length;
+    runs = var.xres / (8 * g_cabc.step);
+
+    /* rows as far apart as the runs in a row, offset so a static ui isn't always missed the same way */
+    for (y = g_cabc.step / 2; y < (int)var.yres; y += g_cabc.step) {
+        const unsigned char *row = front + y * fix.line_length;
+        if (bpp == 4)
+            cabc_histogram_32(row, runs, 8 * g_cabc.step * 4,
+                              var.red.offset >> 3, var.green.offset >> 3, var.blue.offset >> 3,
+                              g_cabc.histogram);
+        else
+            cabc_histogram_16(row, runs, 8 * g_cabc.step * 2, g_cabc.histogram);
+    }
+
+    for (i = 0; i < CABC_BINS; i++)
+        total += g_cabc.histogram[i];
+    if (total == 0)
+        return -1;
+
+    for (i = 0; i < CABC_BINS; i++) {
+        seen += g_cabc.histogram[i];
+        if (seen * 50 >= total * 49)
+            break;
+    }
+    return (i << 2) + 3;
+}
+
+static void *
+cabc_thread(void *arg)
+{
+    unsigned int ticks = 0;
+    long long start, cost;
+    int luma, target, user, applied;
+
+    while (g_cabc.running) {
+        usleep(CABC_PERIOD_MS * 1000);
+
+        pthread_mutex_lock(&g_lock);
+        user = (g_ramp.target < 0) ? 0 : g_backlight;
+        pthread_mutex_unlock(&g_lock);
+        if (user <= 5)
+            continue;   /* off or not set yet, nothing to save */
+
+        start = cabc_thread_time_us();
+        luma = cabc_sample();
+        cost = cabc_thread_time_us() - start;
+
+        /* stay inside the budget with a coarser grid, refine again when well under it */
+        if (cost > CABC_BUDGET_US && g_cabc.step < CABC_MAX_STEP)
+            g_cabc.step <<= 1;
+        else if (cost < CABC_BUDGET_US / 4 && g_cabc.step > CABC_MIN_STEP)
+            g_cabc.step >>= 1;
+
+        target = 100;
+        if (luma >= 0) {
+            target = (luma + CABC_HEADROOM) * 100 / 255;
+            if (target > 100)
+                target = 100;
+            if (target < g_cabc.min_percent)
+                target = g_cabc.min_percent;
+        }
+
+        pthread_mutex_lock(&g_lock);
+        if (target != g_cabc.scale) {
+            /* a few percent per period, a jump would show */
+            if (target > g_cabc.scale)
+                g_cabc.scale += (target - g_cabc.scale < CABC_RAMP) ? target - g_cabc.scale : CABC_RAMP;
+            else
+                g_cabc.scale -= (g_cabc.scale - target < CABC_RAMP) ? g_cabc.scale - target : CABC_RAMP;
+
+            ramp_set_target_locked();
+        }
+        applied = cabc_apply_scale(g_backlight);
+        user = g_backlight;
+        pthread_mutex_unlock(&g_lock);
+
+        /* backlight power is about linear in its level */
+        g_cabc.saved_ms += (unsigned long long)(user - applied) * CABC_PERIOD_MS / user;
+
+        if (++ticks % CABC_REPORT_TICKS == 0) {
+            char value[PROPERTY_VALUE_MAX];
+
+            snprintf(value, sizeof(value), "%llu", g_cabc.saved_ms);
+            property_set("sys.cabc.saved_ms", value);
+            LOGV("cabc scale %d%%, grid step %d, sample %lldus, saved %llums\n",
+                 g_cabc.scale, g_cabc.step, cost, g_cabc.saved_ms);
+        }
+    }
+
+    return NULL;
+}
+
+/* start the cabc thread if persist.sys.cabc.enable is set */
+static void
+cabc_start(void)
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    property_get("persist.sys.cabc.enable", value, "0");
+    if (strcmp(value, "1") != 0)
+        return;
+
+    property_get("persist.sys.cabc.min", value, "60");
+    g_cabc.min_percent = atoi(value);
+    if (g_cabc.min_percent < 20)
+        g_cabc.min_percent = 20;
+    if (g_cabc.min_percent > 100)
+        g_cabc.min_percent = 100;
+
+    g_cabc.fb_fd = open("/dev/graphics/fb0", O_RDONLY);
+    if (g_cabc.fb_fd < 0) {
+        LOGE("cabc: can't open fb0, errno = %d\n", errno);
+        return;
+    }
+
+    g_cabc.scale = 100;
+    g_cabc.step = CABC_MIN_STEP;
+    g_cabc.running = 1;
+    if (pthread_create(&g_cabc.thread, NULL, cabc_thread, NULL) != 0) {
+        LOGE("cabc: can't start thread\n");
+        g_cabc.running = 0;
+        close(g_cabc.fb_fd);
+        return;
+    }
+
+    LOGD("cabc on, backlight down to %d%%\n", g_cabc.min_percent);
+}
+
+static void
+cabc_stop(void)
+{
+    if (!g_cabc.running)
+        return;
+
+    g_cabc.running = 0;
+    pthread_join(g_cabc.thread, NULL);
+
+    if (g_cabc.fb_base)
+        munmap(g_cabc.fb_base, g_cabc.fb_size);
+    close(g_cabc.fb_fd);
+    memset(&g_cabc, 0, sizeof(g_cabc));
+}
+
+static int
+set_light_backlight(struct light_device_t* dev,
+        struct light_state_t const* state)
+{
+    struct light_context_t      *ctx = (struct light_context_t *)dev;
     int brightness = rgb_to_brightness(state);
+    unsigned long  args[3];
+	
+    int err = 0;
 	
     pthread_mutex_lock(&g_lock);	
     g_backlight = brightness;
-    ctx = (struct light_context_t *)dev;
-    unsigned long  args[3];
-
-	args[0]  = 0;
-	args[1]  = brightness;
-	args[2]  = 0;
-	err = ioctl(ctx->fd,DISP_CMD_LCD_SET_BRIGHTNESS,args);
-	
-	if(err == 0)
-	{
-		g_backlight = brightness;
-	}
-
+    if (g_ramp.running) {
+        ramp_set_target_locked();
+    } else {
+        /* no ramp thread, set the panel directly */
+        args[0]  = 0;
+        args[1]  = brightness;
+        args[2]  = 0;
+        err = ioctl(ctx->fd,DISP_CMD_LCD_SET_BRIGHTNESS,args);
+    }
     pthread_mutex_unlock(&g_lock);
     
     return err;
@@ -155,6 +632,11 @@ close_lights(struct light_device_t *dev)
     struct light_context_t *ctx;
 
     ctx = (struct light_context_t *)dev;
+    if(ctx->fd > 0 && ctx->fd == g_ramp.fd)
+    {
+        cabc_stop();
+        ramp_stop();
+    }
     if(ctx->fd)
     {
         close(ctx->fd);
@@ -208,7 +690,11 @@ static int open_lights(const struct hw_module_t* module, char const* name,
         if (dev->fd < 0)
         {
             LOGE("Failed to open display device dev->fd = %x\n",dev->fd);
-        }       
+        }
+        else if (!g_ramp.running && ramp_start(dev->fd) == 0)
+        {
+            cabc_start();
+        }
     }
     
     dev->device.common.tag = HARDWARE_DEVICE_TAG;